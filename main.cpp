@@ -1,5 +1,9 @@
+#include <avr/wdt.h>
+
 #include <SPI.h>
 #include <Ethernet.h>
+#include <utility/w5100.h>
+#include <EEPROM.h>
 
 #include <SdFat.h>
 
@@ -12,6 +16,11 @@ const uint8_t SD_CHIP_SELECT = 4;
 // file system
 SdFat sd;
 
+// SD card SPI speed, one of SPI_FULL_SPEED to SPI_SIXTEENTH_SPEED. Chosen
+// per unit with /api/bench or /api/spi and kept in EEPROM across resets.
+const int SD_SPEED_EEPROM_ADDRESS = 0;
+uint8_t sd_spi_speed = SPI_HALF_SPEED;
+
 // Enter a MAC address and IP address for your controller below.
 // The IP address will be dependent on your local network:
 byte mac[] = { 0x90, 0xA2, 0xDA, 0x00, 0x44, 0x68 };
@@ -22,6 +31,17 @@ IPAddress ip(10, 0, 0, 24);
 // (port 80 is default for HTTP):
 EthernetServer server(80);
 
+#if defined(__AVR__)
+// After a watchdog reset WDRF keeps the watchdog running at its shortest
+// period, which would reset the board again long before setup() finishes.
+// Clear it before anything else runs.
+void clearWatchdogReset() __attribute__((naked, used, section(".init3")));
+void clearWatchdogReset() {
+    MCUSR = 0;
+    wdt_disable();
+}
+#endif
+
 template <typename T>
 void printkv(const String& key, const T & value) {
     Serial.print(key);
@@ -35,15 +55,184 @@ void setup()
 
 	pinMode(SLAVE_SELECT, OUTPUT);     // change this to 53 on a mega
 	digitalWrite(SLAVE_SELECT, HIGH);  // Disable W5100 Ethernet
-	if (!sd.begin(SD_CHIP_SELECT, SPI_HALF_SPEED)) sd.initErrorHalt();
+	uint8_t saved_speed = EEPROM.read(SD_SPEED_EEPROM_ADDRESS);
+	if (saved_speed <= SPI_SIXTEENTH_SPEED) {
+	    sd_spi_speed = saved_speed;
+	}
+	if (!sd.begin(SD_CHIP_SELECT, sd_spi_speed)) {
+	    // Fall back to the speed which used to be hard-coded
+	    sd_spi_speed = SPI_HALF_SPEED;
+	    if (!sd.begin(SD_CHIP_SELECT, sd_spi_speed)) sd.initErrorHalt();
+	}
+	printkv("sd_spi_speed", sd_spi_speed);
 
 	Ethernet.begin(mac, ip);
 	Serial.println(F("Beginning server..."));
 	server.begin();
+
+	// Freeing a cluster chain (remove, O_TRUNC, truncate) is a single SdFat
+	// call which cannot kick the watchdog, so the watchdog is kicked just
+	// before each. With 32 KB clusters freeing takes about 10 ms per 4 MB,
+	// which keeps files up to about 1 GB inside the period.
+	wdt_enable(WDTO_8S);
 }
 
 #define HTTP_BUFFER_SIZE 255
 
+// Per-connection read limits, in milliseconds. The header limit bounds the
+// request line and header block as a whole; the idle limit is the longest
+// silence tolerated while a body is being read. Both must stay well inside
+// the watchdog period set in setup().
+const unsigned long HEADER_TIMEOUT_MS = 5000;
+const unsigned long BODY_IDLE_TIMEOUT_MS = 3000;
+
+// Bodies arriving slower than this, once the grace period has elapsed, are
+// abandoned so that one slow client cannot monopolise the server.
+const unsigned long MIN_TRANSFER_RATE = 512; // bytes per second
+const unsigned long MIN_RATE_GRACE_MS = 5000;
+
+// Form bodies are read into a String, so they are refused beyond this size.
+const long MAX_FORM_CONTENT_LENGTH = 512;
+
+// Read deadline for the connection currently being served, against millis().
+// While the headers are read the deadline is fixed; while the body is read
+// each arrival of data pushes it back by read_idle_timeout, and the body as
+// a whole must keep up MIN_TRANSFER_RATE.
+unsigned long read_deadline;
+unsigned long read_idle_timeout;
+bool read_timed_out;
+unsigned long body_started;
+long body_received;
+
+bool transferTooSlow(long transferred, unsigned long started) {
+    unsigned long elapsed = millis() - started;
+    if (elapsed < MIN_RATE_GRACE_MS) {
+        return false;
+    }
+    return transferred < static_cast<long>(elapsed / 1000 * MIN_TRANSFER_RATE);
+}
+
+void beginHeaderDeadline() {
+    read_deadline = millis() + HEADER_TIMEOUT_MS;
+    read_idle_timeout = 0;
+    read_timed_out = false;
+}
+
+void beginBodyDeadline() {
+    read_idle_timeout = BODY_IDLE_TIMEOUT_MS;
+    read_deadline = millis() + read_idle_timeout;
+    body_started = millis();
+    body_received = 0;
+}
+
+/**
+ *  Record that the client is making progress: kick the watchdog and, while
+ *  reading a body, extend the idle deadline.
+ */
+void readProgress() {
+    wdt_reset();
+    if (read_idle_timeout > 0) {
+        read_deadline = millis() + read_idle_timeout;
+    }
+}
+
+bool readDeadlineExpired() {
+    if (static_cast<long>(millis() - read_deadline) >= 0) {
+        read_timed_out = true;
+    }
+    else if (read_idle_timeout > 0 && transferTooSlow(body_received, body_started)) {
+        Serial.println(F("Body too slow"));
+        read_timed_out = true;
+    }
+    return read_timed_out;
+}
+
+void countBodyBytes(int count) {
+    if (read_idle_timeout > 0 && count > 0) {
+        body_received += count;
+    }
+}
+
+/**
+ *  Wait until the client has data available.
+ *
+ *  Returns:
+ *      The number of bytes available, or zero if the client disconnected or
+ *      the read deadline passed first.
+ */
+int waitAvailable(EthernetClient & client) {
+    while (!read_timed_out && client.connected()) {
+        int available = client.available();
+        if (available > 0) {
+            readProgress();
+            return available;
+        }
+        if (readDeadlineExpired()) {
+            break;
+        }
+    }
+    return 0;
+}
+
+// Bytes read from the client but not yet used, read_ahead_length of them
+// from read_ahead_start. The W5100 is read in whole buffers rather than
+// byte by byte, saving a round of SPI commands per byte, and a reader which
+// has to look past the end of what it wants leaves the rest here.
+uint8_t read_ahead[HTTP_BUFFER_SIZE];
+uint8_t read_ahead_start;
+uint8_t read_ahead_length;
+
+/**
+ *  Make sure there are bytes waiting in read_ahead, reading as many as the
+ *  client has sent, up to HTTP_BUFFER_SIZE, if there are none.
+ *
+ *  Returns:
+ *      The number of bytes waiting, or zero if none arrived in time.
+ */
+uint8_t fillReadAhead(EthernetClient & client) {
+    if (read_ahead_length == 0) {
+        read_ahead_start = 0;
+        int available = waitAvailable(client);
+        if (available == 0) {
+            return 0;
+        }
+        int num_read = client.read(read_ahead, min(available, HTTP_BUFFER_SIZE));
+        read_ahead_length = num_read < 0 ? 0 : num_read;
+    }
+    return read_ahead_length;
+}
+
+/**
+ *  Read one byte from the client, waiting no longer than the read deadline.
+ *
+ *  Returns:
+ *      The byte read, or -1.
+ */
+int readByte(EthernetClient & client) {
+    if (fillReadAhead(client) == 0) {
+        return -1;
+    }
+    countBodyBytes(1);
+    --read_ahead_length;
+    return read_ahead[read_ahead_start++];
+}
+
+/**
+ *  Read up to length bytes from the client, waiting no longer than the read
+ *  deadline for the first of them.
+ *
+ *  Returns:
+ *      The number of bytes read, or zero if none arrived in time.
+ */
+int readBytes(EthernetClient & client, uint8_t * buffer, int length) {
+    int num_read = min(static_cast<int>(fillReadAhead(client)), length);
+    memcpy(buffer, read_ahead + read_ahead_start, num_read);
+    read_ahead_start += num_read;
+    read_ahead_length -= num_read;
+    countBodyBytes(num_read);
+    return num_read;
+}
+
 
 /**
  *  Read a line from the EthernetClient.
@@ -51,33 +240,31 @@ void setup()
 String readHttpLine(EthernetClient & client) {
 	char buffer[HTTP_BUFFER_SIZE + 1];
 	int index = 0;
-	while (client.connected()) {
-		if (client.available()) {
-			int b = client.read();
+	while (true) {
+		int b = readByte(client);
 
-			if (b == -1) { // no data
-				break;
-			}
+		if (b == -1) { // no data before the deadline
+			break;
+		}
 
-			//Serial.println(b);
-			//Serial.flush();
+		//Serial.println(b);
+		//Serial.flush();
 
-			char c = static_cast<char>(b);
+		char c = static_cast<char>(b);
 
-			if (c == '\r') {   // carriage-return
-				b = client.read(); // line-feed
-				//Serial.println(b);
-				//Serial.flush();
-				break;
-			}
+		if (c == '\r') {   // carriage-return
+			b = readByte(client); // line-feed
+			//Serial.println(b);
+			//Serial.flush();
+			break;
+		}
 
-	        buffer[index] = c;
-	        ++index;
+		buffer[index] = c;
+		++index;
 
-            if (index == HTTP_BUFFER_SIZE) {
-                break;
-            }
-	    }
+		if (index == HTTP_BUFFER_SIZE) {
+			break;
+		}
 	}
 	buffer[index] = '\0';
 	//Serial.println(index);
@@ -123,50 +310,54 @@ void readHttpHeaders(EthernetClient & client, long & content_length, String & co
 	}
 }
 
-int readMultipartFormDataHeader(EthernetClient & client, String & boundary, String & disposition, String & content_type) {
-    int header_length = 0;
-    boundary = readHttpLine(client);
-    header_length += boundary.length() + 2;
-    //Serial.print(F("BOUNDARY: "));
-    //Serial.println(boundary);
+/**
+ * Read the headers of one part of a multipart/form-data body, up to and
+ * including the blank line which separates them from the part content.
+ */
+void readMultipartPartHeaders(EthernetClient & client, String & disposition, String & content_type) {
     while (true) {
         String header_line = readHttpLine(client);
-        header_length += header_line.length() + 2;
         Serial.print(F("MULTIHEADER: "));
         Serial.println(header_line);
 
         if (header_line.startsWith("Content-Disposition:")) {
             disposition = header_line.substring(21);
-            //Serial.print(F("Disposition = "));
-            //Serial.println(disposition);
         }
         else if (header_line.startsWith("Content-Type:")) {
             content_type = header_line.substring(14);
-            //Serial.print(F("Content type = "));
-            //Serial.println(content_type);
-            //Serial.flush();
         }
-        Serial.println(header_line.length());
         if (header_line.length() == 0) {
-            //Serial.println(F("End header!"));
             break;
         }
     }
-    return header_length;
 }
 
 void skipHttpContent(EthernetClient& client, long content_length) {
-    for (long i = 0; i < content_length; ++i) {
-        int b = client.read();
-        if (b == -1) {
+    uint8_t buffer[32];
+    long skipped = 0;
+    while (skipped < content_length) {
+        int num_read = readBytes(client, buffer, min(content_length - skipped, 32L));
+        if (num_read == 0) {
             break;
         }
-     }
+        skipped += num_read;
+    }
 }
 
-void readHttpContent(EthernetClient& client, long content_length, String& content) {
+/**
+ * Read a form body into content.
+ *
+ * Returns:
+ *     false, without reading anything, if the body is longer than
+ *     MAX_FORM_CONTENT_LENGTH.
+ */
+bool readHttpContent(EthernetClient& client, long content_length, String& content) {
+	if (content_length > MAX_FORM_CONTENT_LENGTH) {
+		return false;
+	}
+	content.reserve(content_length);
 	for (long i = 0; i < content_length; ++i) {
-		int b = client.read();
+		int b = readByte(client);
 		if (b == -1) {
 			break;
 		}
@@ -176,6 +367,7 @@ void readHttpContent(EthernetClient& client, long content_length, String& conten
 
 	//Serial.print(F("CONTENT: "));
 	//Serial.println(content);
+	return true;
 }
 
 /**
@@ -244,6 +436,20 @@ void httpGone(EthernetClient& client) {
 	client.println();
 }
 
+void httpRequestTimeout(EthernetClient& client) {
+    client.println(F("HTTP/1.1 408 Request Timeout"));
+    client.println(F("Connection: close"));
+    client.println(F("Content-Length: 0"));
+    client.println();
+}
+
+void httpPayloadTooLarge(EthernetClient& client) {
+    client.println(F("HTTP/1.1 413 Payload Too Large"));
+    client.println(F("Connection: close"));
+    client.println(F("Content-Length: 0"));
+    client.println();
+}
+
 void httpInternalServerError(EthernetClient& client, const String & content) {
     client.println(F("HTTP/1.1 500 Internal Server Error"));
     client.println(F("Content-Type: text/plain"));
@@ -281,6 +487,30 @@ String makeString(String value) {
     return value;
 }
 
+/**
+ * Escape s for use inside a JSON string.
+ */
+String jsonEscape(const String & s) {
+    String escaped;
+    for (unsigned i = 0; i < s.length(); ++i) {
+        char c = s[i];
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<uint8_t>(c) < 0x20) {
+            const char hex_digits[] = "0123456789abcdef";
+            escaped += "\\u00";
+            escaped += hex_digits[c >> 4];
+            escaped += hex_digits[c & 0xF];
+        }
+        else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
 template <typename T>
 void httpOkScalar(EthernetClient& client, T scalar) {
 	String response_content = makeString(scalar);
@@ -322,6 +552,126 @@ void htmlHeader(EthernetClient& client, const String & title) {
     client.println(F("</head>"));
 }
 
+#define PATH_CACHE_SIZE 4
+
+// A small LRU cache of open directories keyed by their path from the root,
+// such as "DATA/LOGS/", so that opening a path can start from its deepest
+// cached ancestor instead of reading every parent directory from the card
+// again. 8.3 names are stored upper case, so keys are upper-cased and
+// "data/" finds "DATA/". Any handler which changes the directory tree must
+// call pathCacheInvalidate().
+SdBaseFile path_cache_dirs[PATH_CACHE_SIZE];
+String path_cache_keys[PATH_CACHE_SIZE];
+unsigned long path_cache_last_used[PATH_CACHE_SIZE]; // zero when empty
+unsigned long path_cache_clock;
+unsigned long path_cache_hits;
+unsigned long path_cache_misses;
+unsigned long path_cache_evictions;
+
+void pathCacheInvalidate() {
+    for (uint8_t i = 0; i < PATH_CACHE_SIZE; ++i) {
+        if (path_cache_last_used[i] != 0) {
+            path_cache_dirs[i].close();
+            path_cache_keys[i] = "";
+            path_cache_last_used[i] = 0;
+        }
+    }
+}
+
+/**
+ * Choose the slot to open a directory into: an empty one if there is one,
+ * otherwise the least recently used. The slot in use as the parent of the
+ * new directory is never chosen.
+ */
+uint8_t pathCacheVictim(int8_t parent_slot) {
+    uint8_t victim = parent_slot == 0 ? 1 : 0;
+    for (uint8_t i = 0; i < PATH_CACHE_SIZE; ++i) {
+        if (i != parent_slot && path_cache_last_used[i] < path_cache_last_used[victim]) {
+            victim = i;
+        }
+    }
+    if (path_cache_last_used[victim] != 0) {
+        path_cache_dirs[victim].close();
+        ++path_cache_evictions;
+    }
+    return victim;
+}
+
+/**
+ * Open the directory at path, relative to the root with or without leading
+ * and trailing slashes, starting from its deepest cached ancestor and
+ * caching each directory opened on the way.
+ *
+ * Returns:
+ *     The open directory, which belongs to the cache and must not be closed,
+ *     or null if there is no such directory.
+ */
+SdBaseFile * resolveDir(const String & path) {
+    String key = path.startsWith("/") ? path.substring(1) : path;
+    if (key.length() == 0) {
+        return sd.vwd();
+    }
+    if (!key.endsWith("/")) {
+        key += '/';
+    }
+    key.toUpperCase();
+
+    int8_t best_slot = -1;
+    unsigned best_length = 0;
+    for (uint8_t i = 0; i < PATH_CACHE_SIZE; ++i) {
+        if (path_cache_last_used[i] == 0) {
+            continue;
+        }
+        const String & cached_key = path_cache_keys[i];
+        if (cached_key.length() > best_length && key.startsWith(cached_key)) {
+            best_slot = i;
+            best_length = cached_key.length();
+        }
+    }
+    if (best_length == key.length()) {
+        ++path_cache_hits;
+        path_cache_last_used[best_slot] = ++path_cache_clock;
+        return &path_cache_dirs[best_slot];
+    }
+    ++path_cache_misses;
+
+    SdBaseFile * parent = best_slot < 0 ? sd.vwd() : &path_cache_dirs[best_slot];
+    unsigned start = best_length;
+    while (start < key.length()) {
+        unsigned end = key.indexOf('/', start);
+        String component = key.substring(start, end);
+        uint8_t slot = pathCacheVictim(best_slot);
+        path_cache_last_used[slot] = 0;
+        SdBaseFile & dir = path_cache_dirs[slot];
+        if (!dir.open(parent, component.c_str(), O_READ)) {
+            return 0;
+        }
+        if (!dir.isDir()) {
+            dir.close();
+            return 0;
+        }
+        path_cache_keys[slot] = key.substring(0, end + 1);
+        path_cache_last_used[slot] = ++path_cache_clock;
+        parent = &dir;
+        best_slot = slot;
+        start = end + 1;
+    }
+    return parent;
+}
+
+/**
+ * Open the file or directory at path, resolving its parent through the
+ * path cache.
+ */
+bool openThroughPathCache(SdBaseFile & file, const String & path, uint8_t oflag) {
+    int slash_index = path.lastIndexOf('/');
+    SdBaseFile * parent = resolveDir(path.substring(0, slash_index + 1));
+    if (parent == 0) {
+        return false;
+    }
+    return file.open(parent, path.substring(slash_index + 1).c_str(), oflag);
+}
+
 String extractValueWithKey(const String & s, const String & key) {
     int index = s.indexOf(' ' + key + '=');
     int start = index + key.length() + 3;
@@ -329,134 +679,244 @@ String extractValueWithKey(const String & s, const String & key) {
     return s.substring(start, end);
 }
 
-void uploadFile(EthernetClient & client, const String & boundary, const String & path,
-                const String & filename, long expected_length) {
-    printkv("boundary", boundary);
-    printkv("path", path);
-    printkv("filename", filename);
-    printkv("expected_length", expected_length);
+// RFC 2046 limits boundaries to 70 characters, and the delimiter which
+// separates parts is CRLF, "--" and the boundary.
+#define MULTIPART_MAX_DELIMITER 74
 
-    String full_path = path + filename;
+enum MultipartPartEnd {
+    PART_FOLLOWS,
+    PART_LAST,
+    PART_BROKEN,
+};
 
-    SdFile new_file;
-    if (!new_file.open(full_path.c_str(), O_RDWR | O_CREAT | O_AT_END)) {
-       httpInternalServerError(client, "Opening " + filename + " for write failed");
-       return;
-    }
+/**
+ * Destination for the content of a multipart part: a file, a String or
+ * neither, in which case the content is discarded. File writes are
+ * buffered so that they reach the card in blocks.
+ */
+struct PartSink {
+    SdBaseFile * file;
+    String * value;
+    bool write_ok;
+    int buffered;
+    uint8_t buffer[HTTP_BUFFER_SIZE];
+};
 
-    // TODO: Watchdog timer
-    uint8_t buffer[HTTP_BUFFER_SIZE + 1];
-    long actual_length = 0;
-    while (client.connected()) {
-        while (int available = client.available()) {
-            long num_remaining = expected_length - actual_length;
-            int num_to_read = min(min(available, HTTP_BUFFER_SIZE), num_remaining);
-            int num_read = client.read(buffer, num_to_read);
-            if (num_read < 0) {
-                break;
-            }
-            actual_length += num_read;
-            Serial.print(actual_length);
-            Serial.print(" : ");
-            Serial.println(expected_length);
-            //buffer[num_read] = '\0';
-            //for (int i = 0; i < num_read; ++i) {
-            //    Serial.print(static_cast<int>(buffer[i]));
-            //    Serial.print(' ');
-            //}
-            //Serial.println();
-            new_file.write(buffer, num_read);
-
-            if (actual_length >= expected_length) {
-                goto stop;
-            }
+void initPartSink(PartSink & sink, SdBaseFile * file, String * value) {
+    sink.file = file;
+    sink.value = value;
+    sink.write_ok = true;
+    sink.buffered = 0;
+}
+
+void flushPartSink(PartSink & sink) {
+    if (sink.file != 0 && sink.buffered > 0) {
+        if (sink.file->write(sink.buffer, sink.buffered) != sink.buffered) {
+            sink.write_ok = false;
+            sink.file = 0;
         }
     }
+    sink.buffered = 0;
+}
 
-    stop:
+void putPartSink(PartSink & sink, uint8_t b) {
+    if (sink.value != 0 && sink.value->length() < HTTP_BUFFER_SIZE) {
+        *sink.value += static_cast<char>(b);
+    }
+    if (sink.file != 0) {
+        sink.buffer[sink.buffered++] = b;
+        if (sink.buffered == HTTP_BUFFER_SIZE) {
+            flushPartSink(sink);
+        }
+    }
+}
 
-    new_file.close();
+/**
+ * Stream the content of a multipart part, up to the delimiter which ends
+ * it, into sink.
+ *
+ * The content is taken straight from read_ahead, a whole buffer at a time,
+ * and whatever follows the delimiter is left there for the next part.
+ *
+ * Args:
+ *     delimiter: CRLF, "--" and the boundary
+ *     sink: Where to put the content
+ *
+ * Returns:
+ *     PART_FOLLOWS or PART_LAST according to whether another part follows
+ *     the delimiter, or PART_BROKEN if the client went away or was too slow.
+ */
+MultipartPartEnd readMultipartPart(EthernetClient & client, const String & delimiter,
+                                   PartSink & sink) {
+    uint8_t delimiter_length = delimiter.length();
+    uint8_t matched = 0;
+
+    while (matched < delimiter_length) {
+        if (fillReadAhead(client) == 0) {
+            return PART_BROKEN;
+        }
 
-    readHttpLine(client); // Swallow newline
-    String end_boundary = readHttpLine(client);
-    //printkv("end_boundary", end_boundary);
-    if (end_boundary != boundary + "--") {
-        //Serial.println(F("Missing boundary"));
-        new_file.remove();
-        httpBadRequest(client, "Missing boundary");
-        return;
+        uint8_t consumed_from = read_ahead_start;
+        while (read_ahead_length > 0 && matched < delimiter_length) {
+            uint8_t b = read_ahead[read_ahead_start++];
+            --read_ahead_length;
+            if (b == static_cast<uint8_t>(delimiter[matched])) {
+                ++matched;
+                continue;
+            }
+            // The partial match was content after all. The delimiter's only
+            // CR is its first character, so a new match can only start at b.
+            for (uint8_t j = 0; j < matched; ++j) {
+                putPartSink(sink, delimiter[j]);
+            }
+            matched = 0;
+            if (b == '\r') {
+                matched = 1;
+            }
+            else {
+                putPartSink(sink, b);
+            }
+        }
+        countBodyBytes(read_ahead_start - consumed_from);
     }
-    renderDirList(client, path);
-    return;
-}
+    flushPartSink(sink);
 
-int readUploadPath(EthernetClient & client, String & path) {
-    String boundary;
-    String disposition;
-    String part_content_type;
-    int header_length = readMultipartFormDataHeader(client, boundary, disposition, part_content_type);
-    if (header_length == 0) {
-        return -1;
+    // The delimiter is followed by CRLF and another part, or by "--"
+    int first = readByte(client);
+    int second = readByte(client);
+    if (first == '-' && second == '-') {
+        return PART_LAST;
     }
-    Serial.println(disposition);
-    String name = extractValueWithKey(disposition, "name");
-    printkv("name", name);
-    if (name != "path") {
-        return -1;
+    if (first == '\r' && second == '\n') {
+        return PART_FOLLOWS;
     }
-
-    // Read two lines, the first of which is the field value, the second of which
-    // is the boundary
-    path = readHttpLine(client);
-    printkv("path", path);
-    return header_length + path.length() + 2;
+    return PART_BROKEN;
 }
 
-int readUploadFilename(EthernetClient & client, String & filename, String & boundary) {
-    String disposition;
-    String part_content_type;
-    int header_length = readMultipartFormDataHeader(client, boundary, disposition, part_content_type);
-    if (header_length == 0) {
-        return -1;
+/**
+ * Stream the outcome for one file of an upload, with error null if it was
+ * stored.
+ */
+void printUploadResult(EthernetClient & client, bool & first, const String & full_path,
+                       long size, const char * error) {
+    String result = first ? "{\"path\":\"" : ",\r\n{\"path\":\"";
+    first = false;
+    result += jsonEscape(full_path);
+    if (error == 0) {
+        result += "\",\"size\":" + String(size) + ",\"ok\":true}";
     }
-    Serial.println(disposition);
-    String name = extractValueWithKey(disposition, "name");
-    if (name != "fileToUpload") {
-        return -1;
+    else {
+        result += "\",\"ok\":false,\"error\":\"";
+        result += error;
+        result += "\"}";
     }
-
-    filename = extractValueWithKey(disposition, "filename");
-
-    return header_length;
+    client.print(result);
 }
 
+/**
+ * Store every file part of a multipart/form-data upload in the directory
+ * given by the preceding path part, streaming a JSON object giving the
+ * outcome for each file as it is stored. Files stored before a broken part
+ * stay on the card, so the summary ends by saying whether the body was
+ * complete and, if not, what went wrong with which part.
+ */
 void handleFileUpload(EthernetClient & client, const String & content_type, long content_length) {
+    printkv("content_length", content_length);
 
-    String path;
-    int part1_length = readUploadPath(client, path);
-    if (part1_length < 0) {
-        httpBadRequest(client, "Missing path");
+    String first_boundary = readHttpLine(client);
+    if (read_timed_out) {
+        httpRequestTimeout(client);
+        return;
     }
-
-    String filename;
-    String boundary;
-    int part2_length = readUploadFilename(client, filename, boundary);
-    if (part2_length < 0) {
-        httpBadRequest(client, "Missing filename");
+    String delimiter = "\r\n" + first_boundary;
+    if (!first_boundary.startsWith("--") || first_boundary.length() <= 2
+            || delimiter.length() > MULTIPART_MAX_DELIMITER) {
+        httpBadRequest(client, "Missing boundary");
+        return;
     }
 
-    if (filename.length() > 12) {
-        // TODO: Should check for 8.3 compliance
-        httpBadRequest(client, "Filename too long.");
-        return;
+    httpOk(client, "application/json");
+    client.println(F("{\"files\":["));
+    bool first_result = true;
+    String path;
+    String part_name;
+    PartSink sink;
+    MultipartPartEnd end = PART_FOLLOWS;
+    while (end == PART_FOLLOWS) {
+        String disposition;
+        String part_content_type;
+        part_name = "";
+        readMultipartPartHeaders(client, disposition, part_content_type);
+        if (read_timed_out) {
+            end = PART_BROKEN;
+            break;
+        }
+        String name = extractValueWithKey(disposition, "name");
+        printkv("name", name);
+        part_name = name;
+
+        if (name == "path") {
+            path = "";
+            initPartSink(sink, 0, &path);
+            end = readMultipartPart(client, delimiter, sink);
+            printkv("path", path);
+            continue;
+        }
+        String filename = name == "fileToUpload" ?
+                extractValueWithKey(disposition, "filename") : String();
+        initPartSink(sink, 0, 0);
+        if (filename.length() == 0) {
+            end = readMultipartPart(client, delimiter, sink);
+            continue;
+        }
+        printkv("filename", filename);
+        part_name = filename;
+        String full_path = path + filename;
+
+        if (filename.length() > 12) {
+            // TODO: Should check for 8.3 compliance
+            end = readMultipartPart(client, delimiter, sink);
+            if (end != PART_BROKEN) {
+                printUploadResult(client, first_result, full_path, 0, "Filename too long");
+            }
+            continue;
+        }
+
+        SdFile new_file;
+        wdt_reset(); // O_TRUNC frees the old file's cluster chain
+        if (!openThroughPathCache(new_file, full_path, O_WRITE | O_CREAT | O_TRUNC)) {
+            end = readMultipartPart(client, delimiter, sink);
+            if (end != PART_BROKEN) {
+                printUploadResult(client, first_result, full_path, 0, "Opening for write failed");
+            }
+            continue;
+        }
+        initPartSink(sink, &new_file, 0);
+        end = readMultipartPart(client, delimiter, sink);
+        long size = new_file.fileSize();
+        new_file.close();
+        if (end == PART_BROKEN || !sink.write_ok) {
+            wdt_reset();
+            sd.remove(full_path.c_str());
+        }
+        if (end != PART_BROKEN) {
+            printUploadResult(client, first_result, full_path, size, sink.write_ok ? 0 : "Write failed");
+        }
     }
 
-    printkv("content_length", content_length);
-    printkv("part1_length", part1_length);
-    printkv("part2_length", part2_length);
-    printkv("boundary.length()", boundary.length());
-    long expected_length = content_length - part1_length - part2_length - (boundary.length() + 6);
-    uploadFile(client, boundary, path, filename, expected_length);
+    pathCacheInvalidate();
+
+    client.println();
+    client.print(F("],\"complete\":"));
+    if (end == PART_BROKEN) {
+        String broken = "false,\"error\":\"";
+        broken += read_timed_out ? "Timed out" : "Missing boundary";
+        broken += "\",\"part\":\"" + jsonEscape(part_name) + "\"}";
+        client.println(broken);
+    }
+    else {
+        client.println(F("true}"));
+    }
 }
 
 void hidden_path_field(EthernetClient client, const String & path) {
@@ -478,26 +938,24 @@ void renderBrowseItem(EthernetClient& client, const String& path,
 }
 
 void renderDirList(EthernetClient& client, const String& path) {
-    SdBaseFile dir;
-    bool success =
-            path.length() == 0 ?
-                    dir.openRoot(sd.vol()) : dir.open(path.c_str(), O_READ);
-    if (!success) {
+    SdBaseFile * dir = resolveDir(path);
+    if (dir == 0) {
         httpBadRequest(client, "Cannot open directory " + path);
         return;
     }
-    dir.rewind();
+    dir->rewind();
     httpOk(client, "text/html");
     htmlHeader(client, "Listing - Mistral");
     client.println(F("<body>"));
     client.println(F("<ul>"));
-    if (!dir.isRoot()) {
+    if (!dir->isRoot()) {
         int slash_index = path.substring(0, path.length() - 1).lastIndexOf('/');
         String parent_path = path.substring(0, slash_index + 1);
         renderBrowseItem(client, parent_path, "", ".. Parent");
     }
     dir_t p;
-    while (dir.readDir(&p) > 0) {
+    while (dir->readDir(&p) > 0) {
+        wdt_reset();
 
         if (p.name[0] == DIR_NAME_FREE)
             break;
@@ -542,7 +1000,7 @@ void renderDirList(EthernetClient& client, const String& path) {
     hidden_path_field(client, path);
     client.println(
             F(
-                    "<input type=\"file\" name=\"fileToUpload\" id=\"fileToUpload\" />"));
+                    "<input type=\"file\" name=\"fileToUpload\" id=\"fileToUpload\" multiple />"));
     client.println(F("<input type=\"submit\" value=\"Upload\"/>"));
     client.println(F("</form>"));
     client.println(
@@ -585,7 +1043,7 @@ void handleFileBrowseRequest(EthernetClient & client, const String & path, long
     Serial.println(F("FILE"));
     Serial.println(path);
     SdFile file;
-    if (!file.open(sd.vwd(), path.c_str(), O_READ)) {
+    if (!openThroughPathCache(file, path, O_READ)) {
        httpNotFound(client, "Could not open " + path);
        return;
     }
@@ -605,6 +1063,7 @@ void handleFileBrowseRequest(EthernetClient & client, const String & path, long
     int16_t c;
     while ((c = file.read()) >= 0) {
         client.print(static_cast<char>(c));
+        wdt_reset(); // Still sending, so still making progress
     }
 
     file.close();
@@ -626,7 +1085,14 @@ void handleFileDelete(EthernetClient & client,  HttpMethod method, const String
     }
 
     String content;
-    readHttpContent(client, content_length, content);
+    if (!readHttpContent(client, content_length, content)) {
+        httpPayloadTooLarge(client);
+        return;
+    }
+    if (read_timed_out) {
+        httpRequestTimeout(client);
+        return;
+    }
 
     content = url_decode(content);
 
@@ -644,12 +1110,14 @@ void handleFileDelete(EthernetClient & client,  HttpMethod method, const String
     String full_path = path + filename;
 
     bool success;
+    wdt_reset();
     if (filename.endsWith("/")) {
         success = sd.rmdir(full_path.c_str());
     }
     else {
         success = sd.remove(full_path.c_str());
     }
+    pathCacheInvalidate();
     if (!success) {
         httpBadRequest(client, "Could not delete " + full_path);
         return;
@@ -663,7 +1131,14 @@ void handleMkDir(EthernetClient & client,  HttpMethod method, const String & con
     }
 
     String content;
-    readHttpContent(client, content_length, content);
+    if (!readHttpContent(client, content_length, content)) {
+        httpPayloadTooLarge(client);
+        return;
+    }
+    if (read_timed_out) {
+        httpRequestTimeout(client);
+        return;
+    }
 
     content = url_decode(content);
 
@@ -679,6 +1154,7 @@ void handleMkDir(EthernetClient & client,  HttpMethod method, const String & con
 
     String full_path = path + dirname;
     bool success = sd.mkdir(full_path.c_str());
+    pathCacheInvalidate();
     if (!success) {
         httpBadRequest(client, "Could not make directory " + dirname);
         return;
@@ -686,32 +1162,990 @@ void handleMkDir(EthernetClient & client,  HttpMethod method, const String & con
     renderDirList(client, path);
 }
 
-void handleRequest(EthernetClient & client, HttpMethod method, const String & url, const String & content_type, long content_length) {
-    if (url.startsWith("/sd/")) {
-        handleFileSystemRequest(client, url, content_length);
-    } else if (url == "/upload") {
-        handleFileUpload(client, content_type, content_length);
-    } else if (url == "/delete") {
-        handleFileDelete(client, method, content_type, content_length);
-    } else if (url == "/mkdir") {
-        handleMkDir(client, method, content_type, content_length);
-	} else if (url == "/favicon.ico") {
-		httpGone(client);
-	} else {
-		httpNotFound(client, "No resource at this URL");
-	}
+#define WALK_MAX_DEPTH 8
+#define WALK_MAX_PATH 127
+
+// Explicit directory stack for walking a subtree without recursion, which
+// the AVR stack cannot afford. walk_dirs[i] is open on the directory at
+// depth i, and its read position records how far through it the walk has
+// got. walk_path holds the path of the deepest open directory, and
+// walk_path_length[i] the length of the path of the directory at depth i.
+SdBaseFile walk_dirs[WALK_MAX_DEPTH];
+char walk_path[WALK_MAX_PATH + 1];
+uint8_t walk_path_length[WALK_MAX_DEPTH];
+int8_t walk_depth = -1;
+
+/**
+ * Open the directory at path as the root of a walk.
+ */
+bool walkBegin(const String & path) {
+    walk_depth = -1;
+    String relative_path = path.startsWith("/") ? path.substring(1) : path;
+    SdBaseFile & root = walk_dirs[0];
+    bool success =
+            relative_path.length() == 0 ?
+                    root.openRoot(sd.vol()) : root.open(sd.vwd(), relative_path.c_str(), O_READ);
+    if (!success) {
+        return false;
+    }
+    if (!root.isDir() || relative_path.length() + 2 > WALK_MAX_PATH) {
+        root.close();
+        return false;
+    }
+    uint8_t length = 0;
+    walk_path[length++] = '/';
+    for (unsigned i = 0; i < relative_path.length(); ++i) {
+        walk_path[length++] = relative_path[i];
+    }
+    if (walk_path[length - 1] != '/') {
+        walk_path[length++] = '/';
+    }
+    walk_path[length] = '\0';
+    walk_path_length[0] = length;
+    walk_depth = 0;
+    root.rewind();
+    return true;
 }
 
-void loop()
-{
-    // listen for incoming clients
-    EthernetClient client = server.available();
-    if (client) {
-	    String url;
-	    String content_type;
-	    long content_length;
-	    HttpMethod method = readHttpRequest(client, /*out*/ url, /*out*/ content_type, /*out*/ content_length);
-		handleRequest(client, method, url, content_type, content_length);
+/**
+ * Read the next file or subdirectory entry from the deepest open directory.
+ *
+ * Returns:
+ *     false when that directory is exhausted.
+ */
+bool walkRead(dir_t * p) {
+    SdBaseFile & dir = walk_dirs[walk_depth];
+    while (dir.readDir(p) > 0) {
+        wdt_reset();
+
+        if (p->name[0] == DIR_NAME_FREE)
+            return false;
+
+        if (p->name[0] == DIR_NAME_DELETED || p->name[0] == '.')
+            continue;
+
+        if (!DIR_IS_FILE_OR_SUBDIR(p))
+            continue;
+
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Append the dotted 8.3 name of p to walk_path after the deepest open
+ * directory.
+ *
+ * Returns:
+ *     The new length of walk_path, or zero if it would not fit.
+ */
+uint8_t walkAppendName(const dir_t & p) {
+    uint8_t length = walk_path_length[walk_depth];
+    for (uint8_t i = 0; i < 11; i++) {
+        if (p.name[i] == ' ')
+            continue;
+        if (length + 2 > WALK_MAX_PATH) {
+            walk_path[walk_path_length[walk_depth]] = '\0';
+            return 0;
+        }
+        if (i == 8)
+            walk_path[length++] = '.';
+        walk_path[length++] = static_cast<char>(p.name[i]);
+    }
+    walk_path[length] = '\0';
+    return length;
+}
+
+/**
+ * Descend into the subdirectory p, which must be the entry most recently
+ * returned by walkRead().
+ */
+bool walkPush(const dir_t & p) {
+    if (walk_depth + 1 >= WALK_MAX_DEPTH) {
+        return false;
+    }
+    uint8_t length = walkAppendName(p);
+    if (length == 0) {
+        return false;
+    }
+    SdBaseFile & parent = walk_dirs[walk_depth];
+    uint16_t index = parent.curPosition() / sizeof(dir_t) - 1;
+    if (!walk_dirs[walk_depth + 1].open(&parent, index, O_READ)) {
+        walk_path[walk_path_length[walk_depth]] = '\0';
+        return false;
+    }
+    walk_path[length++] = '/';
+    walk_path[length] = '\0';
+    ++walk_depth;
+    walk_path_length[walk_depth] = length;
+    return true;
+}
+
+/**
+ * Close the deepest open directory and return to its parent.
+ */
+void walkPop() {
+    walk_dirs[walk_depth].close();
+    --walk_depth;
+    if (walk_depth >= 0) {
+        walk_path[walk_path_length[walk_depth]] = '\0';
+    }
+}
+
+/**
+ * The character at index i of the dotted form of the space padded 8.3
+ * name in p, where base_length is the length of the name without padding.
+ */
+char dirNameCharAt(const dir_t & p, uint8_t base_length, uint8_t i) {
+    if (i < base_length) {
+        return p.name[i];
+    }
+    if (i == base_length) {
+        return '.';
+    }
+    return p.name[8 + i - base_length - 1];
+}
+
+/**
+ * Match a glob pattern using '*' and '?' against the name of a directory
+ * entry, working directly on the raw space padded name. 8.3 names are
+ * stored upper case, so the pattern is upper-cased as it is matched.
+ */
+bool matchDirName(const dir_t & p, const char * glob) {
+    uint8_t base_length = 8;
+    while (base_length > 0 && p.name[base_length - 1] == ' ') {
+        --base_length;
+    }
+    uint8_t extension_length = 3;
+    while (extension_length > 0 && p.name[8 + extension_length - 1] == ' ') {
+        --extension_length;
+    }
+    uint8_t length = base_length + (extension_length > 0 ? extension_length + 1 : 0);
+
+    const char * star = 0;
+    uint8_t star_index = 0;
+    uint8_t i = 0;
+    while (i < length) {
+        if (*glob == '*') {
+            star = ++glob;
+            star_index = i;
+            continue;
+        }
+        char c = dirNameCharAt(p, base_length, i);
+        if (*glob != '\0' && (*glob == '?' || toupper(*glob) == c)) {
+            ++glob;
+            ++i;
+            continue;
+        }
+        if (star == 0) {
+            return false;
+        }
+        // Let the last star swallow one more character and try again
+        glob = star;
+        i = ++star_index;
+    }
+    while (*glob == '*') {
+        ++glob;
+    }
+    return *glob == '\0';
+}
+
+/**
+ * Parse a timestamp such as 2014-01-31 or 2014-01-31T12:30:00 into a packed
+ * FAT date (high word) and time (low word), which compare in time order.
+ * Any non-digit characters are treated as separators. Fields out of range,
+ * including years FAT cannot represent, are rejected.
+ */
+bool parseFatTimestamp(const String & s, uint32_t & timestamp) {
+    uint16_t fields[6] = { 0, 0, 0, 0, 0, 0 };
+    const uint8_t widths[6] = { 4, 2, 2, 2, 2, 2 };
+    uint8_t field = 0;
+    uint8_t digits = 0;
+    for (unsigned i = 0; i < s.length() && field < 6; ++i) {
+        char c = s[i];
+        if (!isdigit(c)) {
+            continue;
+        }
+        fields[field] = fields[field] * 10 + (c - '0');
+        if (++digits == widths[field]) {
+            ++field;
+            digits = 0;
+        }
+    }
+    if (field < 3 || fields[0] < 1980 || fields[0] > 2107
+            || fields[1] < 1 || fields[1] > 12 || fields[2] < 1 || fields[2] > 31
+            || fields[3] > 23 || fields[4] > 59 || fields[5] > 59) {
+        return false;
+    }
+    uint16_t date = (fields[0] - 1980) << 9 | fields[1] << 5 | fields[2];
+    uint16_t time = fields[3] << 11 | fields[4] << 5 | fields[5] / 2;
+    timestamp = static_cast<uint32_t>(date) << 16 | time;
+    return true;
+}
+
+// Each line of the find results is formatted whole and sent in a single
+// write, as the W5100 sends each write as a segment of its own.
+#define FIND_LINE_SIZE (WALK_MAX_PATH + 80)
+
+void writeFindLine(EthernetClient & client, const char * line, int length) {
+    if (length >= FIND_LINE_SIZE) {
+        length = FIND_LINE_SIZE - 1;
+    }
+    if (length > 0) {
+        client.write(reinterpret_cast<const uint8_t *>(line), length);
+    }
+}
+
+void printFindMatch(EthernetClient & client, const dir_t & p) {
+    char line[FIND_LINE_SIZE];
+    int length = snprintf(line, sizeof(line),
+            "{\"path\":\"%s\",\"dir\":%s,\"size\":%lu,"
+            "\"modified\":\"%04u-%02u-%02uT%02u:%02u:%02u\"}\r\n",
+            walk_path, DIR_IS_SUBDIR(&p) ? "true" : "false",
+            static_cast<unsigned long>(p.fileSize),
+            static_cast<unsigned>(FAT_YEAR(p.lastWriteDate)),
+            static_cast<unsigned>(FAT_MONTH(p.lastWriteDate)),
+            static_cast<unsigned>(FAT_DAY(p.lastWriteDate)),
+            static_cast<unsigned>(FAT_HOUR(p.lastWriteTime)),
+            static_cast<unsigned>(FAT_MINUTE(p.lastWriteTime)),
+            static_cast<unsigned>(FAT_SECOND(p.lastWriteTime)));
+    writeFindLine(client, line, length);
+}
+
+void printWalkError(EthernetClient & client, const char * error) {
+    char line[FIND_LINE_SIZE];
+    int length = snprintf(line, sizeof(line), "{\"error\":\"%s\",\"path\":\"%s\"}\r\n",
+            error, walk_path);
+    writeFindLine(client, line, length);
+}
+
+/**
+ * Search the tree below root for entries whose names match glob and, if
+ * newer is given, which were modified after it, streaming one JSON object
+ * per match.
+ *
+ * GET /api/find?root=/DATA/&glob=*.CSV&newer=2014-01-31T12:00:00
+ */
+void handleFind(EthernetClient & client, HttpMethod method, const String & url, long content_length) {
+    if (method != HTTP_GET) {
+        httpMethodNotAllowed(client, "Method not allowed");
+        return;
+    }
+    skipHttpContent(client, content_length);
+
+    String root = url_query_param(url, "root");
+    String glob = url_query_param(url, "glob");
+    if (glob.length() == 0) {
+        glob = "*";
+    }
+    String newer = url_query_param(url, "newer");
+    // Loggers without a clock leave timestamps at zero, so without newer
+    // there must be no filter at all rather than a filter on zero
+    bool filter_newer = newer.length() > 0;
+    uint32_t newer_than = 0;
+    if (filter_newer && !parseFatTimestamp(newer, newer_than)) {
+        httpBadRequest(client, "Bad timestamp " + newer);
+        return;
+    }
+    printkv("root", root);
+    printkv("glob", glob);
+
+    if (!walkBegin(root)) {
+        httpNotFound(client, "Could not open directory " + root);
+        return;
+    }
+
+    httpOk(client, "application/x-ndjson");
+    dir_t p;
+    while (walk_depth >= 0) {
+        if (!client.connected()) {
+            Serial.println(F("Find abandoned"));
+            while (walk_depth >= 0) {
+                walkPop();
+            }
+            break;
+        }
+        if (!walkRead(&p)) {
+            walkPop();
+            continue;
+        }
+        uint32_t modified = static_cast<uint32_t>(p.lastWriteDate) << 16 | p.lastWriteTime;
+        if ((!filter_newer || modified > newer_than) && matchDirName(p, glob.c_str())) {
+            if (walkAppendName(p) > 0) {
+                printFindMatch(client, p);
+            }
+            walk_path[walk_path_length[walk_depth]] = '\0';
+        }
+        if (DIR_IS_SUBDIR(&p) && !walkPush(p)) {
+            walkAppendName(p);
+            printWalkError(client, "Too deep");
+            walk_path[walk_path_length[walk_depth]] = '\0';
+        }
+    }
+}
+
+/**
+ * Remove the directory at path together with everything below it, walking
+ * the subtree depth first with the walk stack rather than by recursion.
+ * Each directory is removed once its contents have been.
+ *
+ * Returns:
+ *     The number of files and directories removed, or -1 if any of the
+ *     tree could not be removed.
+ */
+long removeTree(const String & path) {
+    if (!walkBegin(path)) {
+        return -1;
+    }
+    if (walk_dirs[0].isRoot()) {
+        walkPop();
+        return -1;
+    }
+    long removed = 0;
+    bool complete = true;
+    dir_t p;
+    while (walk_depth >= 0) {
+        if (!walkRead(&p)) {
+            // Now empty, unless something below could not be removed
+            if (walk_dirs[walk_depth].rmdir()) {
+                ++removed;
+            }
+            else {
+                complete = false;
+            }
+            walkPop();
+            continue;
+        }
+        if (DIR_IS_SUBDIR(&p)) {
+            if (!walkPush(p)) {
+                complete = false;
+            }
+            continue;
+        }
+        SdBaseFile & parent = walk_dirs[walk_depth];
+        uint16_t index = parent.curPosition() / sizeof(dir_t) - 1;
+        SdBaseFile file;
+        wdt_reset();
+        if (file.open(&parent, index, O_WRITE) && file.remove()) {
+            ++removed;
+        }
+        else {
+            complete = false;
+        }
+    }
+    return complete ? removed : -1;
+}
+
+enum FormPairResult {
+    FORM_PAIR_READ,
+    FORM_END,
+    FORM_PAIR_TOO_LONG,
+    FORM_BROKEN,
+};
+
+/**
+ * Read the next key=value pair of an url-encoded form body as it arrives,
+ * so that a long body never has to be held in memory.
+ *
+ * Returns:
+ *     FORM_PAIR_READ if a pair was read, FORM_END at the end of the body,
+ *     FORM_PAIR_TOO_LONG if a pair was longer than HTTP_BUFFER_SIZE, or
+ *     FORM_BROKEN if the client went away or was too slow.
+ */
+FormPairResult readFormPair(EthernetClient & client, long & remaining, String & key, String & value) {
+    if (remaining <= 0) {
+        return FORM_END;
+    }
+    char buffer[HTTP_BUFFER_SIZE + 1];
+    int length = 0;
+    while (remaining > 0) {
+        int b = readByte(client);
+        if (b == -1) {
+            return FORM_BROKEN;
+        }
+        --remaining;
+        if (b == '&') {
+            break;
+        }
+        if (length == HTTP_BUFFER_SIZE) {
+            return FORM_PAIR_TOO_LONG;
+        }
+        buffer[length++] = static_cast<char>(b);
+    }
+    buffer[length] = '\0';
+
+    char * equals = strchr(buffer, '=');
+    if (equals != 0) {
+        *equals = '\0';
+        value = url_decode(String(equals + 1));
+    }
+    else {
+        value = "";
+    }
+    key = url_decode(String(buffer));
+    return FORM_PAIR_READ;
+}
+
+/**
+ * Delete several files or directories in a single request, streaming a
+ * JSON summary of the outcome for each. The body is parsed as it arrives,
+ * and path and recursive apply to the names which follow them. Directories,
+ * named with a trailing slash, are removed with their contents if recursive
+ * is non-zero, otherwise only if they are empty.
+ *
+ * POST /api/delete
+ * path=/LOGS/&recursive=1&name=OLD.TXT&name=2013/
+ */
+void handleBulkDelete(EthernetClient & client, HttpMethod method, long content_length) {
+    if (method != HTTP_POST) {
+        httpMethodNotAllowed(client, "Method not allowed");
+        return;
+    }
+
+    long remaining = content_length;
+    String path;
+    bool recursive = false;
+    bool responding = false;
+    String key;
+    String value;
+    FormPairResult result;
+    while ((result = readFormPair(client, remaining, key, value)) == FORM_PAIR_READ) {
+        if (key == "path") {
+            path = value.startsWith("/") ? value.substring(1) : value;
+            continue;
+        }
+        if (key == "recursive") {
+            recursive = value.length() > 0 && value != "0";
+            continue;
+        }
+        if (key != "name" || value.length() == 0) {
+            continue;
+        }
+
+        if (!responding) {
+            httpOk(client, "application/json");
+            client.println(F("{\"results\":["));
+            responding = true;
+        }
+        else {
+            client.println(',');
+        }
+
+        String full_path = path + value;
+        printkv("delete", full_path);
+        unsigned long work_started = millis();
+        long removed;
+        wdt_reset();
+        if (!value.endsWith("/")) {
+            removed = sd.remove(full_path.c_str()) ? 1 : -1;
+        }
+        else if (recursive) {
+            removed = removeTree(full_path);
+        }
+        else {
+            removed = sd.rmdir(full_path.c_str()) ? 1 : -1;
+        }
+        // Time spent deleting is not held against the client's transfer rate
+        body_started += millis() - work_started;
+        readProgress();
+
+        client.print(F("{\"path\":\""));
+        client.print(jsonEscape(full_path));
+        if (removed < 0) {
+            client.print(F("\",\"ok\":false}"));
+        }
+        else {
+            client.print(F("\",\"ok\":true,\"removed\":"));
+            client.print(removed);
+            client.print('}');
+        }
+    }
+
+    if (!responding) {
+        if (read_timed_out) {
+            httpRequestTimeout(client);
+        }
+        else if (result == FORM_PAIR_TOO_LONG) {
+            httpPayloadTooLarge(client);
+        }
+        else if (result == FORM_BROKEN) {
+            httpBadRequest(client, "Incomplete body");
+        }
+        else {
+            httpBadRequest(client, "Missing name");
+        }
+        return;
+    }
+
+    pathCacheInvalidate();
+    client.println();
+    client.print(F("],\"complete\":"));
+    client.print(result == FORM_END ? F("true") : F("false"));
+    client.println('}');
+}
+
+#define BENCH_BLOCK_SIZE 512
+#define BENCH_DEFAULT_BLOCKS 64
+#define BENCH_MAX_BLOCKS 2048
+
+// Network benchmarks move at most this much, so that one of them cannot
+// hold the server for long.
+const long BENCH_MAX_NET_BYTES = 1048576L;
+
+const char BENCH_FILENAME[] = "BENCH.TMP";
+
+/**
+ * Set the SD SPI speed and, if save is true, keep it for the next reset.
+ */
+bool setSdSpiSpeed(uint8_t speed, bool save) {
+    if (speed > SPI_SIXTEENTH_SPEED || !sd.card()->setSckRate(speed)) {
+        return false;
+    }
+    sd_spi_speed = speed;
+    if (save && EEPROM.read(SD_SPEED_EEPROM_ADDRESS) != speed) {
+        EEPROM.write(SD_SPEED_EEPROM_ADDRESS, speed);
+    }
+    return true;
+}
+
+void fillBenchBlock(uint8_t * block, uint16_t block_number) {
+    for (uint16_t i = 0; i < BENCH_BLOCK_SIZE; ++i) {
+        block[i] = static_cast<uint8_t>(block_number + i);
+    }
+}
+
+bool checkBenchBlock(const uint8_t * block, uint16_t block_number) {
+    for (uint16_t i = 0; i < BENCH_BLOCK_SIZE; ++i) {
+        if (block[i] != static_cast<uint8_t>(block_number + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Bytes per second for a transfer of bytes which took the given number of
+ * microseconds.
+ */
+uint32_t benchRate(uint32_t bytes, uint32_t elapsed_us) {
+    if (elapsed_us == 0) {
+        elapsed_us = 1;
+    }
+    return static_cast<uint64_t>(bytes) * 1000000UL / elapsed_us;
+}
+
+enum BenchTest {
+    BENCH_SEQUENTIAL_WRITE,
+    BENCH_SEQUENTIAL_READ,
+    BENCH_RANDOM_READ,
+    BENCH_RANDOM_WRITE,
+    BENCH_TEST_COUNT,
+};
+
+/**
+ * Write the test pattern to the blocks from first_block on, in order, adding
+ * the time the writes took to elapsed_us.
+ */
+bool writeBenchPattern(uint32_t first_block, uint16_t blocks, uint32_t & elapsed_us) {
+    Sd2Card * card = sd.card();
+    uint8_t block[BENCH_BLOCK_SIZE];
+    for (uint16_t b = 0; b < blocks; ++b) {
+        fillBenchBlock(block, b);
+        uint32_t started = micros();
+        bool ok = card->writeBlock(first_block + b, block);
+        elapsed_us += micros() - started;
+        if (!ok) {
+            return false;
+        }
+        wdt_reset();
+    }
+    return true;
+}
+
+/**
+ * Read the blocks from first_block on, in order, checking each against the
+ * test pattern outside the timed region and adding the time the reads took
+ * to elapsed_us.
+ */
+bool readBenchPattern(uint32_t first_block, uint16_t blocks, uint32_t & elapsed_us) {
+    Sd2Card * card = sd.card();
+    uint8_t block[BENCH_BLOCK_SIZE];
+    for (uint16_t b = 0; b < blocks; ++b) {
+        uint32_t started = micros();
+        bool ok = card->readBlock(first_block + b, block);
+        elapsed_us += micros() - started;
+        if (!ok || !checkBenchBlock(block, b)) {
+            return false;
+        }
+        wdt_reset();
+    }
+    return true;
+}
+
+/**
+ * Time sequential and random 512 byte reads and writes of the blocks from
+ * first_block on, which must already hold the test pattern, at the current
+ * SPI speed. Every block read is checked outside the timed region.
+ *
+ * The card runs without CRC checks, so at a speed which is too fast a write
+ * command with a corrupted address is accepted and lands on whatever block
+ * it now names. The reads therefore come first, and the speed is trusted
+ * with writes only once they have all checked out.
+ *
+ * Returns:
+ *     false if any operation or check failed, in which case elapsed_us is
+ *     incomplete and, if the writes had begun, the pattern may be damaged.
+ */
+bool benchSd(uint32_t first_block, uint16_t blocks, uint32_t elapsed_us[BENCH_TEST_COUNT]) {
+    Sd2Card * card = sd.card();
+    uint8_t block[BENCH_BLOCK_SIZE];
+    uint32_t started;
+    bool ok;
+
+    for (uint8_t t = 0; t < BENCH_TEST_COUNT; ++t) {
+        elapsed_us[t] = 0;
+    }
+
+    if (!readBenchPattern(first_block, blocks, elapsed_us[BENCH_SEQUENTIAL_READ])) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < blocks; ++i) {
+        uint16_t b = random(blocks);
+        started = micros();
+        ok = card->readBlock(first_block + b, block);
+        elapsed_us[BENCH_RANDOM_READ] += micros() - started;
+        if (!ok || !checkBenchBlock(block, b)) {
+            return false;
+        }
+        wdt_reset();
+    }
+
+    uint32_t verify_us = 0;
+    if (!writeBenchPattern(first_block, blocks, elapsed_us[BENCH_SEQUENTIAL_WRITE])
+            || !readBenchPattern(first_block, blocks, verify_us)) {
+        return false;
+    }
+
+    // Each block is rewritten with its own pattern, so it can be checked
+    for (uint16_t i = 0; i < blocks; ++i) {
+        uint16_t b = random(blocks);
+        fillBenchBlock(block, b);
+        started = micros();
+        ok = card->writeBlock(first_block + b, block);
+        elapsed_us[BENCH_RANDOM_WRITE] += micros() - started;
+        if (!ok || !card->readBlock(first_block + b, block) || !checkBenchBlock(block, b)) {
+            return false;
+        }
+        wdt_reset();
+    }
+    return true;
+}
+
+/**
+ * Benchmark the SD card at each SPI speed, streaming the results as JSON.
+ * The scratch file is allocated contiguously and filled with the test
+ * pattern at the current speed, which is known to work. At the others only
+ * its data blocks are touched, and only read until they have read back
+ * intact.
+ *
+ * With apply=1, which changes the saved setting and so needs a POST, the
+ * speed with the shortest total time is made the current speed and saved;
+ * otherwise the current speed is restored.
+ *
+ * GET /api/bench?blocks=64
+ * POST /api/bench?blocks=64&apply=1
+ */
+void handleSdBench(EthernetClient & client, HttpMethod method, const String & url, long content_length) {
+    String apply_value = url_query_param(url, "apply");
+    bool apply = apply_value.length() > 0 && apply_value != "0";
+    if (!(method == HTTP_GET && !apply) && method != HTTP_POST) {
+        httpMethodNotAllowed(client, "Method not allowed");
+        return;
+    }
+    skipHttpContent(client, content_length);
+
+    String blocks_value = url_query_param(url, "blocks");
+    long blocks = blocks_value.length() > 0 ? blocks_value.toInt() : BENCH_DEFAULT_BLOCKS;
+    if (blocks < 1 || blocks > BENCH_MAX_BLOCKS) {
+        httpBadRequest(client, "Bad blocks " + blocks_value);
+        return;
+    }
+
+    // Remove any scratch file left by an interrupted run
+    wdt_reset();
+    sd.remove(BENCH_FILENAME);
+    SdBaseFile file;
+    uint32_t first_block;
+    uint32_t last_block;
+    uint32_t fill_us = 0;
+    bool allocated = file.createContiguous(sd.vwd(), BENCH_FILENAME, blocks * BENCH_BLOCK_SIZE)
+            && file.contiguousRange(&first_block, &last_block);
+    file.close();
+    allocated = allocated && writeBenchPattern(first_block, blocks, fill_us);
+    if (!allocated) {
+        sd.remove(BENCH_FILENAME);
+        httpInternalServerError(client, "Could not allocate scratch file");
+        return;
+    }
+
+    const char * const test_names[BENCH_TEST_COUNT] = {
+        "seq_write", "seq_read", "random_read", "random_write"
+    };
+    uint8_t original_speed = sd_spi_speed;
+    uint8_t best_speed = original_speed;
+    uint32_t best_total_us = 0;
+    bool any_ok = false;
+
+    httpOk(client, "application/json");
+    client.print(F("{\"blocks\":"));
+    client.print(blocks);
+    client.print(F(",\"block_size\":"));
+    client.print(BENCH_BLOCK_SIZE);
+    client.println(F(",\"speeds\":["));
+    for (uint8_t speed = SPI_FULL_SPEED; speed <= SPI_SIXTEENTH_SPEED; ++speed) {
+        uint32_t elapsed_us[BENCH_TEST_COUNT];
+        bool ok = setSdSpiSpeed(speed, false) && benchSd(first_block, blocks, elapsed_us);
+        if (!ok) {
+            // Repair the pattern at the known good speed for the next speed
+            setSdSpiSpeed(original_speed, false);
+            fill_us = 0;
+            writeBenchPattern(first_block, blocks, fill_us);
+        }
+
+        client.print(F("{\"speed\":"));
+        client.print(speed);
+        client.print(F(",\"ok\":"));
+        client.print(ok ? F("true") : F("false"));
+        if (ok) {
+            uint32_t total_us = 0;
+            for (uint8_t t = 0; t < BENCH_TEST_COUNT; ++t) {
+                client.print(F(",\""));
+                client.print(test_names[t]);
+                client.print(F("\":"));
+                client.print(benchRate(blocks * BENCH_BLOCK_SIZE, elapsed_us[t]));
+                total_us += elapsed_us[t];
+            }
+            if (!any_ok || total_us < best_total_us) {
+                best_total_us = total_us;
+                best_speed = speed;
+                any_ok = true;
+            }
+        }
+        client.println(speed < SPI_SIXTEENTH_SPEED ? F("},") : F("}"));
+    }
+
+    // Return to a known good speed before touching the file system again
+    setSdSpiSpeed(original_speed, false);
+    wdt_reset();
+    sd.remove(BENCH_FILENAME);
+    if (apply && any_ok) {
+        setSdSpiSpeed(best_speed, true);
+    }
+
+    client.print(F("],\"unit\":\"bytes/s\",\"current_speed\":"));
+    client.print(sd_spi_speed);
+    client.println('}');
+}
+
+/**
+ * Stream size bytes of generated data, up to BENCH_MAX_NET_BYTES, for the
+ * client to time.
+ *
+ * GET /api/bench/tx?size=65536
+ */
+void handleTxBench(EthernetClient & client, HttpMethod method, const String & url, long content_length) {
+    if (method != HTTP_GET) {
+        httpMethodNotAllowed(client, "Method not allowed");
+        return;
+    }
+    skipHttpContent(client, content_length);
+
+    String size_value = url_query_param(url, "size");
+    long size = size_value.toInt();
+    if (size <= 0 || size > BENCH_MAX_NET_BYTES) {
+        httpBadRequest(client, "Bad size " + size_value);
+        return;
+    }
+
+    uint8_t buffer[HTTP_BUFFER_SIZE];
+    for (int i = 0; i < HTTP_BUFFER_SIZE; ++i) {
+        buffer[i] = 'a' + i % 26;
+    }
+
+    httpOk(client, "application/octet-stream", size);
+    unsigned long started = micros();
+    for (long sent = 0; sent < size && client.connected();) {
+        int num_to_write = min(size - sent, static_cast<long>(HTTP_BUFFER_SIZE));
+        sent += client.write(buffer, num_to_write);
+        wdt_reset();
+    }
+    printkv("tx_us", micros() - started);
+}
+
+/**
+ * Receive and discard a request body of up to BENCH_MAX_NET_BYTES, replying
+ * with the time it took.
+ *
+ * POST /api/bench/rx
+ */
+void handleRxBench(EthernetClient & client, HttpMethod method, long content_length) {
+    if (method != HTTP_POST && method != HTTP_PUT) {
+        httpMethodNotAllowed(client, "Method not allowed");
+        return;
+    }
+    if (content_length > BENCH_MAX_NET_BYTES) {
+        httpPayloadTooLarge(client);
+        return;
+    }
+
+    uint8_t buffer[HTTP_BUFFER_SIZE];
+    long received = 0;
+    unsigned long started = micros();
+    while (received < content_length) {
+        int num_to_read = min(content_length - received, static_cast<long>(HTTP_BUFFER_SIZE));
+        int num_read = readBytes(client, buffer, num_to_read);
+        if (num_read == 0) {
+            break;
+        }
+        received += num_read;
+    }
+    uint32_t elapsed_us = micros() - started;
+    if (read_timed_out) {
+        httpRequestTimeout(client);
+        return;
+    }
+
+    String summary = "{\"bytes\":" + String(received)
+            + ",\"us\":" + String(elapsed_us)
+            + ",\"bytes_per_s\":" + String(benchRate(received, elapsed_us)) + "}";
+    httpOk(client, "application/json", summary.length());
+    client.print(summary);
+}
+
+/**
+ * Report the SD SPI speed or, given speed in a POST, change it and save it.
+ *
+ * GET /api/spi
+ * POST /api/spi?speed=0
+ */
+void handleSpiSpeed(EthernetClient & client, HttpMethod method, const String & url, long content_length) {
+    String speed_value = url_query_param(url, "speed");
+    if (method != HTTP_POST && !(method == HTTP_GET && speed_value.length() == 0)) {
+        httpMethodNotAllowed(client, "Method not allowed");
+        return;
+    }
+    skipHttpContent(client, content_length);
+    if (speed_value.length() > 0) {
+        long speed = speed_value.toInt();
+        if (speed < 0 || speed > SPI_SIXTEENTH_SPEED || !setSdSpiSpeed(speed, true)) {
+            httpBadRequest(client, "Bad speed " + speed_value);
+            return;
+        }
+    }
+    String summary = "{\"speed\":" + String(sd_spi_speed) + "}";
+    httpOk(client, "application/json", summary.length());
+    client.print(summary);
+}
+
+/**
+ * Report the path cache counters.
+ *
+ * GET /api/cache
+ */
+void handlePathCacheStats(EthernetClient & client, long content_length) {
+    skipHttpContent(client, content_length);
+    uint8_t entries = 0;
+    for (uint8_t i = 0; i < PATH_CACHE_SIZE; ++i) {
+        if (path_cache_last_used[i] != 0) {
+            ++entries;
+        }
+    }
+    String summary = "{\"hits\":" + String(path_cache_hits)
+            + ",\"misses\":" + String(path_cache_misses)
+            + ",\"evictions\":" + String(path_cache_evictions)
+            + ",\"entries\":" + String(entries)
+            + ",\"size\":" + String(PATH_CACHE_SIZE) + "}";
+    httpOk(client, "application/json", summary.length());
+    client.print(summary);
+}
+
+void handleRequest(EthernetClient & client, HttpMethod method, const String & url, const String & content_type, long content_length) {
+    if (url.startsWith("/sd/")) {
+        handleFileSystemRequest(client, url, content_length);
+    } else if (url == "/upload") {
+        handleFileUpload(client, content_type, content_length);
+    } else if (url == "/delete") {
+        handleFileDelete(client, method, content_type, content_length);
+    } else if (url == "/mkdir") {
+        handleMkDir(client, method, content_type, content_length);
+    } else if (url == "/api/delete") {
+        handleBulkDelete(client, method, content_length);
+    } else if (url == "/api/find" || url.startsWith("/api/find?")) {
+        handleFind(client, method, url, content_length);
+    } else if (url == "/api/bench" || url.startsWith("/api/bench?")) {
+        handleSdBench(client, method, url, content_length);
+    } else if (url.startsWith("/api/bench/tx?")) {
+        handleTxBench(client, method, url, content_length);
+    } else if (url == "/api/bench/rx") {
+        handleRxBench(client, method, content_length);
+    } else if (url == "/api/spi" || url.startsWith("/api/spi?")) {
+        handleSpiSpeed(client, method, url, content_length);
+    } else if (url == "/api/cache") {
+        handlePathCacheStats(client, content_length);
+	} else if (url == "/favicon.ico") {
+		httpGone(client);
+	} else {
+		httpNotFound(client, "No resource at this URL");
+	}
+}
+
+// millis() at which each W5100 socket was first seen connected with nothing
+// to read, or zero. The Ethernet library only hands over a client once it
+// has sent data, so a client which connects and says nothing would
+// otherwise hold its socket, one of only MAX_SOCK_NUM, forever.
+unsigned long socket_silent_since[MAX_SOCK_NUM];
+
+void evictSilentSockets() {
+    for (uint8_t sock = 0; sock < MAX_SOCK_NUM; ++sock) {
+        EthernetClient client(sock);
+        if (client.status() != SnSR::ESTABLISHED || client.available() > 0) {
+            socket_silent_since[sock] = 0;
+            continue;
+        }
+        unsigned long now = millis();
+        if (socket_silent_since[sock] == 0) {
+            socket_silent_since[sock] = now == 0 ? 1 : now;
+        }
+        else if (now - socket_silent_since[sock] >= HEADER_TIMEOUT_MS) {
+            Serial.println(F("Closing silent socket"));
+            client.stop();
+            socket_silent_since[sock] = 0;
+        }
+    }
+}
+
+void loop()
+{
+    wdt_reset();
+    evictSilentSockets();
+    // listen for incoming clients
+    EthernetClient client = server.available();
+    if (client) {
+	    String url;
+	    String content_type;
+	    long content_length;
+	    read_ahead_length = 0;
+	    beginHeaderDeadline();
+	    HttpMethod method = readHttpRequest(client, /*out*/ url, /*out*/ content_type, /*out*/ content_length);
+	    if (read_timed_out) {
+	        Serial.println(F("Request timed out"));
+	        httpRequestTimeout(client);
+	    }
+	    else {
+	        beginBodyDeadline();
+	        handleRequest(client, method, url, content_type, content_length);
+	    }
     }
     // give the web browser time to receive the data
     delay(1);
@@ -0,0 +1,57 @@
+/*
+ * check.h
+ *
+ * The CHECK macro and string helpers shared by the tests. Each test program
+ * runs its checks and ends main() with checkReport().
+ */
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+static int check_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++check_failures; \
+        } \
+    } while (0)
+
+/**
+ * Print the outcome of the checks under name.
+ *
+ * Returns:
+ *     The exit status for main().
+ */
+inline int checkReport(const char * name) {
+    if (check_failures > 0) {
+        printf("%s: %d failure(s)\n", name, check_failures);
+        return 1;
+    }
+    printf("%s: OK\n", name);
+    return 0;
+}
+
+inline bool contains(const std::string & s, const char * part) {
+    return s.find(part) != std::string::npos;
+}
+
+inline bool startsWith(const std::string & s, const char * prefix) {
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+inline size_t count(const std::string & s, const char * part) {
+    size_t n = 0;
+    for (size_t i = s.find(part); i != std::string::npos; i = s.find(part, i + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+#endif /* CHECK_H_ */
@@ -0,0 +1,65 @@
+/*
+ * fake_network.h
+ *
+ * A fake clock and fake W5100 sockets for driving the sketch from tests.
+ * The clock advances by one millisecond every time a socket is polled, as
+ * polling the W5100 over SPI takes real time on the board.
+ */
+
+#ifndef FAKE_NETWORK_H_
+#define FAKE_NETWORK_H_
+
+#include <string>
+#include <vector>
+
+#include <Ethernet.h>
+
+struct FakeSocket {
+    uint8_t status;
+    std::string rx;
+    std::vector<unsigned long> rx_arrival; // millis() at which each rx byte arrives
+    size_t rx_position;
+    unsigned long reads;  // calls to read the socket's receive buffer
+    std::string tx;
+    unsigned long writes; // calls to send, each of which the W5100 sends as a segment
+    long first_tx_at;   // millis() of the first byte sent, or -1
+    long closed_at;     // millis() at which the server closed it, or -1
+};
+
+extern unsigned long fake_clock;
+extern FakeSocket fake_sockets[MAX_SOCK_NUM];
+
+void resetFakeNetwork();
+
+/**
+ * Connect a client on sock which sends data, the first immediate bytes at
+ * once and the rest one every interval milliseconds.
+ */
+void fakeConnect(uint8_t sock, const std::string & data,
+                 size_t immediate = std::string::npos, unsigned long interval = 0);
+
+/**
+ * Run the sketch's loop() until the server has sent something on sock or
+ * the fake clock reaches limit.
+ */
+void runLoopUntil(unsigned long limit, uint8_t sock);
+
+/**
+ * Send one request on a fresh connection and run loop() until the server
+ * closes it.
+ *
+ * Args:
+ *     head: The request line, followed by any headers without the final
+ *         CRLF
+ *     body: The request body, for which a Content-Length header is added
+ *         unless it is empty
+ *     interval: If non-zero, the body arrives one byte every interval
+ *         milliseconds after the headers
+ *
+ * Returns:
+ *     Everything the server sent.
+ */
+std::string fakeRequest(const std::string & head, const std::string & body = "",
+                        unsigned long interval = 0);
+
+#endif /* FAKE_NETWORK_H_ */
@@ -0,0 +1,390 @@
+/*
+ * fake_sd.cpp
+ *
+ * The stand-in SdFat's files and directories, kept in an in-memory tree.
+ * Entries are never freed, so a directory a test leaves open in the path
+ * cache or the walk stack never dangles after resetFakeSd().
+ */
+
+#include "fake_sd.h"
+
+std::vector<FakeSdOpen> fake_sd_opens;
+
+static FakeEntry * newEntry(FakeEntry * parent, const uint8_t * name, bool dir) {
+    FakeEntry * entry = new FakeEntry();
+    memcpy(entry->name, name, sizeof(entry->name));
+    entry->dir = dir;
+    entry->dot = false;
+    entry->parent = parent;
+    entry->date = 0;
+    entry->time = 0;
+    if (parent != 0) {
+        parent->entries.push_back(entry);
+    }
+    return entry;
+}
+
+static FakeEntry * fakeSdRoot() {
+    static FakeEntry * root = 0;
+    if (root == 0) {
+        uint8_t name[11];
+        memset(name, ' ', sizeof(name));
+        root = newEntry(0, name, true);
+    }
+    return root;
+}
+
+static bool isDeleted(const FakeEntry * entry) {
+    return entry->name[0] == DIR_NAME_DELETED;
+}
+
+/**
+ * Convert a single path component to a space padded 8.3 name, upper-casing
+ * it as SdFat does.
+ */
+static bool make83Name(const std::string & component, uint8_t * name) {
+    memset(name, ' ', 11);
+    size_t dot = component.find('.');
+    std::string base = component.substr(0, dot);
+    std::string extension = dot == std::string::npos ? "" : component.substr(dot + 1);
+    if (base.empty() || base.size() > 8 || extension.size() > 3) {
+        return false;
+    }
+    std::string both = base + extension;
+    for (size_t i = 0; i < both.size(); ++i) {
+        char c = both[i];
+        if (c < 0x21 || c > 0x7E || strchr("\"*+,./:;<=>?[\\]|", c) != 0) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < base.size(); ++i) {
+        name[i] = toupper(base[i]);
+    }
+    for (size_t i = 0; i < extension.size(); ++i) {
+        name[8 + i] = toupper(extension[i]);
+    }
+    return true;
+}
+
+static FakeEntry * findEntry(FakeEntry * dir, const uint8_t * name) {
+    for (size_t i = 0; i < dir->entries.size(); ++i) {
+        FakeEntry * entry = dir->entries[i];
+        if (!isDeleted(entry) && !entry->dot && memcmp(entry->name, name, 11) == 0) {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+static std::vector<std::string> splitPath(const std::string & path) {
+    std::vector<std::string> components;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        if (end > start) {
+            components.push_back(path.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return components;
+}
+
+static void addDotEntries(FakeEntry * dir) {
+    uint8_t name[11];
+    memset(name, ' ', sizeof(name));
+    name[0] = '.';
+    newEntry(dir, name, true)->dot = true;
+    name[1] = '.';
+    newEntry(dir, name, true)->dot = true;
+}
+
+/**
+ * Look up path below dir, making any missing directories on the way, and
+ * the last component too if make_last is set.
+ */
+static FakeEntry * walkPath(FakeEntry * dir, const std::string & path, bool make_dirs,
+                            bool make_last, bool last_is_dir) {
+    if (!path.empty() && path[0] == '/') {
+        dir = fakeSdRoot();
+    }
+    std::vector<std::string> components = splitPath(path);
+    for (size_t i = 0; i < components.size(); ++i) {
+        bool last = i + 1 == components.size();
+        uint8_t name[11];
+        if (dir == 0 || !dir->dir || !make83Name(components[i], name)) {
+            return 0;
+        }
+        FakeEntry * entry = findEntry(dir, name);
+        if (entry == 0 && (last ? make_last : make_dirs)) {
+            entry = newEntry(dir, name, !last || last_is_dir);
+            if (entry->dir) {
+                addDotEntries(entry);
+            }
+        }
+        dir = entry;
+    }
+    return dir;
+}
+
+void resetFakeSd() {
+    fakeSdRoot()->entries.clear();
+    fake_sd_opens.clear();
+}
+
+FakeEntry * fakeSdMakeDir(const std::string & path) {
+    return walkPath(fakeSdRoot(), path, true, true, true);
+}
+
+FakeEntry * fakeSdMakeFile(const std::string & path, const std::string & data,
+                           uint16_t date, uint16_t time) {
+    FakeEntry * entry = walkPath(fakeSdRoot(), path, true, true, false);
+    if (entry != 0 && !entry->dir) {
+        entry->data = data;
+        entry->date = date;
+        entry->time = time;
+    }
+    return entry;
+}
+
+FakeEntry * fakeSdFind(const std::string & path) {
+    return walkPath(fakeSdRoot(), path, false, false, false);
+}
+
+std::string fakeSdPath(const FakeEntry * entry) {
+    std::string path;
+    for (; entry != 0 && entry->parent != 0; entry = entry->parent) {
+        std::string name;
+        for (uint8_t i = 0; i < 11; ++i) {
+            if (entry->name[i] == ' ')
+                continue;
+            if (i == 8)
+                name += '.';
+            name += static_cast<char>(entry->name[i]);
+        }
+        if (entry->dir) {
+            name += '/';
+        }
+        path = name + path;
+    }
+    return path;
+}
+
+bool SdBaseFile::openRoot(SdVolume *) {
+    entry_ = fakeSdRoot();
+    position_ = 0;
+    flags_ = O_READ;
+    return true;
+}
+
+bool SdBaseFile::open(SdBaseFile * dir, const char * path, uint8_t oflag) {
+    if (isOpen() || dir == 0 || !dir->isDir()) {
+        return false;
+    }
+    FakeSdOpen record = { fakeSdPath(dir->entry_), path };
+    fake_sd_opens.push_back(record);
+
+    FakeEntry * existing = walkPath(dir->entry_, path, false, false, false);
+    if (existing != 0) {
+        if ((oflag & O_CREAT) && (oflag & O_EXCL)) {
+            return false;
+        }
+        if (existing->dir && (oflag & O_WRITE)) {
+            return false;
+        }
+        if (oflag & O_TRUNC) {
+            existing->data.clear();
+        }
+        entry_ = existing;
+    }
+    else {
+        if (!(oflag & O_CREAT)) {
+            return false;
+        }
+        std::string relative = path;
+        size_t slash = relative.find_last_of('/');
+        FakeEntry * parent = slash == std::string::npos ?
+                dir->entry_ : walkPath(dir->entry_, relative.substr(0, slash + 1), false, false, false);
+        if (parent == 0 || !parent->dir) {
+            return false;
+        }
+        entry_ = walkPath(parent, relative.substr(slash + 1), false, true, false);
+        if (entry_ == 0) {
+            return false;
+        }
+    }
+    position_ = (oflag & O_AT_END) ? entry_->data.size() : 0;
+    flags_ = oflag;
+    return true;
+}
+
+bool SdBaseFile::open(SdBaseFile * dir, uint16_t index, uint8_t oflag) {
+    if (isOpen() || dir == 0 || !dir->isDir() || index >= dir->entry_->entries.size()) {
+        return false;
+    }
+    FakeEntry * entry = dir->entry_->entries[index];
+    if (isDeleted(entry) || entry->dot || (entry->dir && (oflag & O_WRITE))) {
+        return false;
+    }
+    entry_ = entry;
+    position_ = 0;
+    flags_ = oflag;
+    return true;
+}
+
+bool SdBaseFile::createContiguous(SdBaseFile * dir, const char * path, uint32_t size) {
+    if (size == 0 || !open(dir, path, O_RDWR | O_CREAT | O_EXCL)) {
+        return false;
+    }
+    entry_->data.assign(size, '\0');
+    return true;
+}
+
+bool SdBaseFile::contiguousRange(uint32_t * first, uint32_t * last) {
+    if (!isFile()) {
+        return false;
+    }
+    *first = FAKE_CONTIGUOUS_FIRST_BLOCK;
+    *last = FAKE_CONTIGUOUS_FIRST_BLOCK + (entry_->data.size() + 511) / 512 - 1;
+    return true;
+}
+
+bool SdBaseFile::isRoot() const {
+    return entry_ != 0 && entry_ == fakeSdRoot();
+}
+
+bool SdBaseFile::isDir() const {
+    return entry_ != 0 && entry_->dir;
+}
+
+bool SdBaseFile::isFile() const {
+    return entry_ != 0 && !entry_->dir;
+}
+
+int8_t SdBaseFile::readDir(dir_t * dir) {
+    if (!isDir()) {
+        return -1;
+    }
+    size_t index = position_ / sizeof(dir_t);
+    if (index >= entry_->entries.size()) {
+        return 0;
+    }
+    const FakeEntry * entry = entry_->entries[index];
+    memset(dir, 0, sizeof(*dir));
+    memcpy(dir->name, entry->name, sizeof(dir->name));
+    dir->attributes = entry->dir ? DIR_ATT_DIRECTORY : 0;
+    dir->lastWriteDate = entry->date;
+    dir->lastWriteTime = entry->time;
+    dir->fileSize = entry->dir ? 0 : entry->data.size();
+    position_ += sizeof(dir_t);
+    return sizeof(dir_t);
+}
+
+uint32_t SdBaseFile::fileSize() const {
+    return isFile() ? entry_->data.size() : 0;
+}
+
+bool SdBaseFile::seekSet(uint32_t position) {
+    if (!isFile() || position > entry_->data.size()) {
+        return false;
+    }
+    position_ = position;
+    return true;
+}
+
+int16_t SdBaseFile::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int SdBaseFile::read(void * buffer, uint16_t size) {
+    if (!isFile() || !(flags_ & O_READ)) {
+        return -1;
+    }
+    size_t count = min(static_cast<size_t>(size), entry_->data.size() - position_);
+    memcpy(buffer, entry_->data.data() + position_, count);
+    position_ += count;
+    return count;
+}
+
+int SdBaseFile::write(const void * buffer, uint16_t size) {
+    if (!isFile() || !(flags_ & O_WRITE)) {
+        return -1;
+    }
+    if (flags_ & O_AT_END) {
+        position_ = entry_->data.size();
+    }
+    if (position_ + size > entry_->data.size()) {
+        entry_->data.resize(position_ + size);
+    }
+    memcpy(&entry_->data[position_], buffer, size);
+    position_ += size;
+    return size;
+}
+
+bool SdBaseFile::truncate(uint32_t length) {
+    if (!isFile() || !(flags_ & O_WRITE) || length > entry_->data.size()) {
+        return false;
+    }
+    entry_->data.resize(length);
+    if (position_ > length) {
+        position_ = length;
+    }
+    return true;
+}
+
+bool SdBaseFile::remove() {
+    if (!isFile() || !(flags_ & O_WRITE)) {
+        return false;
+    }
+    entry_->name[0] = DIR_NAME_DELETED;
+    entry_->data.clear();
+    return close();
+}
+
+bool SdBaseFile::rmdir() {
+    if (!isDir() || isRoot()) {
+        return false;
+    }
+    for (size_t i = 0; i < entry_->entries.size(); ++i) {
+        const FakeEntry * entry = entry_->entries[i];
+        if (!entry->dot && !isDeleted(entry)) {
+            return false;
+        }
+    }
+    entry_->name[0] = DIR_NAME_DELETED;
+    return close();
+}
+
+bool SdFat::mkdir(const char * path) {
+    std::string relative = path;
+    size_t end = relative.find_last_not_of('/');
+    if (end == std::string::npos) {
+        return false;
+    }
+    relative.erase(end + 1);
+    size_t slash = relative.find_last_of('/');
+    FakeEntry * parent = slash == std::string::npos ?
+            fakeSdRoot() : walkPath(fakeSdRoot(), relative.substr(0, slash + 1), false, false, false);
+    if (parent == 0 || !parent->dir) {
+        return false;
+    }
+    uint8_t name[11];
+    if (!make83Name(relative.substr(slash + 1), name) || findEntry(parent, name) != 0) {
+        return false;
+    }
+    addDotEntries(newEntry(parent, name, true));
+    return true;
+}
+
+bool SdFat::remove(const char * path) {
+    SdBaseFile file;
+    return file.open(vwd(), path, O_WRITE) && file.remove();
+}
+
+bool SdFat::rmdir(const char * path) {
+    SdBaseFile dir;
+    return dir.open(vwd(), path, O_READ) && dir.rmdir();
+}
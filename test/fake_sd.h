@@ -0,0 +1,62 @@
+/*
+ * fake_sd.h
+ *
+ * The in-memory directory tree behind the stand-in SdFat, and helpers for
+ * building and inspecting it from tests.
+ */
+
+#ifndef FAKE_SD_H_
+#define FAKE_SD_H_
+
+#include <string>
+#include <vector>
+
+#include <SdFat.h>
+
+struct FakeEntry {
+    uint8_t name[11];   // space padded 8.3 name, DIR_NAME_DELETED once removed
+    bool dir;
+    bool dot;           // the "." or ".." entry of a subdirectory
+    FakeEntry * parent;
+    std::vector<FakeEntry *> entries;   // in directory index order
+    std::string data;
+    uint16_t date;
+    uint16_t time;
+};
+
+// An open by name: the path of the directory it started from, such as
+// "A/B/" or "" for the root, and the name or relative path it was given.
+struct FakeSdOpen {
+    std::string dir;
+    std::string name;
+};
+
+extern std::vector<FakeSdOpen> fake_sd_opens;
+
+/**
+ * Empty the card and forget the opens so far.
+ */
+void resetFakeSd();
+
+/**
+ * Make the directory at path, such as "A/B/", and any missing parents.
+ */
+FakeEntry * fakeSdMakeDir(const std::string & path);
+
+/**
+ * Make a file at path, and any missing parent directories.
+ */
+FakeEntry * fakeSdMakeFile(const std::string & path, const std::string & data = "",
+                           uint16_t date = 0, uint16_t time = 0);
+
+/**
+ * The file or directory at path, or null if there is none.
+ */
+FakeEntry * fakeSdFind(const std::string & path);
+
+/**
+ * The path of entry from the root, such as "A/B/" or "A/X.TXT".
+ */
+std::string fakeSdPath(const FakeEntry * entry);
+
+#endif /* FAKE_SD_H_ */
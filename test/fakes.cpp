@@ -0,0 +1,153 @@
+#include <stdio.h>
+
+#include "fake_network.h"
+
+#include <EEPROM.h>
+
+HardwareSerial Serial;
+EthernetClass Ethernet;
+EEPROMClass EEPROM;
+
+unsigned long fake_clock;
+FakeSocket fake_sockets[MAX_SOCK_NUM];
+
+unsigned long millis() { return fake_clock; }
+unsigned long micros() { return fake_clock * 1000; }
+void delay(unsigned long ms) { fake_clock += ms; }
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+long random(long howbig) { return howbig > 0 ? rand() % howbig : 0; }
+long random(long howsmall, long howbig) { return howsmall + random(howbig - howsmall); }
+
+char * dtostrf(double value, signed char width, unsigned char precision, char * buffer) {
+    sprintf(buffer, "%*.*f", width, precision, value);
+    return buffer;
+}
+
+void resetFakeNetwork() {
+    fake_clock = 0;
+    for (uint8_t sock = 0; sock < MAX_SOCK_NUM; ++sock) {
+        FakeSocket & s = fake_sockets[sock];
+        s.status = SnSR::CLOSED;
+        s.rx.clear();
+        s.rx_arrival.clear();
+        s.rx_position = 0;
+        s.reads = 0;
+        s.tx.clear();
+        s.writes = 0;
+        s.first_tx_at = -1;
+        s.closed_at = -1;
+    }
+}
+
+void fakeConnect(uint8_t sock, const std::string & data, size_t immediate, unsigned long interval) {
+    FakeSocket & s = fake_sockets[sock];
+    s.status = SnSR::ESTABLISHED;
+    s.rx = data;
+    for (size_t i = 0; i < data.size(); ++i) {
+        unsigned long delay = i < immediate ? 0 : (i - immediate + 1) * interval;
+        s.rx_arrival.push_back(fake_clock + delay);
+    }
+}
+
+// The sketch under test
+void loop();
+
+void runLoopUntil(unsigned long limit, uint8_t sock) {
+    while (fake_clock < limit && fake_sockets[sock].tx.empty()) {
+        loop();
+    }
+}
+
+std::string fakeRequest(const std::string & head, const std::string & body, unsigned long interval) {
+    resetFakeNetwork();
+    std::string data = head + "\r\n";
+    if (!body.empty()) {
+        data += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    data += "\r\n";
+    fakeConnect(0, data + body, interval > 0 ? data.size() : std::string::npos, interval);
+    while (fake_clock < 600000 && fake_sockets[0].status == SnSR::ESTABLISHED) {
+        loop();
+    }
+    return fake_sockets[0].tx;
+}
+
+uint8_t EthernetClient::status() {
+    return sock_ < MAX_SOCK_NUM ? fake_sockets[sock_].status : SnSR::CLOSED;
+}
+
+uint8_t EthernetClient::connected() {
+    uint8_t s = status();
+    return s == SnSR::ESTABLISHED || (s == SnSR::CLOSE_WAIT && available() > 0);
+}
+
+int EthernetClient::available() {
+    ++fake_clock;
+    if (sock_ >= MAX_SOCK_NUM) {
+        return 0;
+    }
+    FakeSocket & s = fake_sockets[sock_];
+    size_t end = s.rx_position;
+    while (end < s.rx.size() && s.rx_arrival[end] <= fake_clock) {
+        ++end;
+    }
+    return end - s.rx_position;
+}
+
+int EthernetClient::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int EthernetClient::read(uint8_t * buffer, size_t size) {
+    if (sock_ < MAX_SOCK_NUM) {
+        ++fake_sockets[sock_].reads;
+    }
+    size_t count = min(static_cast<size_t>(available()), size);
+    if (count == 0) {
+        return -1;
+    }
+    FakeSocket & s = fake_sockets[sock_];
+    memcpy(buffer, s.rx.data() + s.rx_position, count);
+    s.rx_position += count;
+    return count;
+}
+
+size_t EthernetClient::write(uint8_t b) {
+    return write(&b, 1);
+}
+
+size_t EthernetClient::write(const uint8_t * buffer, size_t size) {
+    // A half-closed socket can still send
+    if (status() != SnSR::ESTABLISHED && status() != SnSR::CLOSE_WAIT) {
+        return 0;
+    }
+    FakeSocket & s = fake_sockets[sock_];
+    if (s.first_tx_at < 0) {
+        s.first_tx_at = fake_clock;
+    }
+    s.tx.append(reinterpret_cast<const char *>(buffer), size);
+    ++s.writes;
+    return size;
+}
+
+void EthernetClient::stop() {
+    if (sock_ < MAX_SOCK_NUM && fake_sockets[sock_].status != SnSR::CLOSED) {
+        fake_sockets[sock_].status = SnSR::CLOSED;
+        fake_sockets[sock_].closed_at = fake_clock;
+    }
+}
+
+EthernetClient EthernetServer::available() {
+    for (uint8_t sock = 0; sock < MAX_SOCK_NUM; ++sock) {
+        EthernetClient client(sock);
+        uint8_t status = client.status();
+        // Like the real library, a client which has sent its request and
+        // half-closed is still handed over
+        if ((status == SnSR::ESTABLISHED || status == SnSR::CLOSE_WAIT) && client.available() > 0) {
+            return client;
+        }
+    }
+    return EthernetClient();
+}
@@ -0,0 +1,138 @@
+/*
+ * Arduino.h
+ *
+ * Host stand-in for the Arduino core, just enough of it to build the
+ * sketch for the tests.
+ */
+
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+typedef uint8_t byte;
+
+#define F(string_literal) (string_literal)
+#define DEC 10
+#define OUTPUT 1
+#define HIGH 1
+#define LOW 0
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+long random(long howbig);
+long random(long howsmall, long howbig);
+char * dtostrf(double value, signed char width, unsigned char precision, char * buffer);
+
+class String {
+public:
+    String() {}
+    String(const char * cstr) : s_(cstr) {}
+    String(const std::string & s) : s_(s) {}
+    explicit String(char c) : s_(1, c) {}
+    explicit String(unsigned char value) : s_(std::to_string(value)) {}
+    explicit String(int value) : s_(std::to_string(value)) {}
+    explicit String(unsigned int value) : s_(std::to_string(value)) {}
+    explicit String(long value) : s_(std::to_string(value)) {}
+    explicit String(unsigned long value) : s_(std::to_string(value)) {}
+    explicit String(float value) : s_(std::to_string(value)) {}
+
+    unsigned int length() const { return s_.size(); }
+    const char * c_str() const { return s_.c_str(); }
+    void reserve(unsigned int size) { s_.reserve(size); }
+
+    char operator[](unsigned int index) const { return index < s_.size() ? s_[index] : 0; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+
+    int indexOf(char c, unsigned int from = 0) const { return position(s_.find(c, from)); }
+    int indexOf(const String & str, unsigned int from = 0) const { return position(s_.find(str.s_, from)); }
+    int lastIndexOf(char c) const { return position(s_.rfind(c)); }
+
+    String substring(unsigned int from) const { return substring(from, s_.size()); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) {
+            unsigned int t = from; from = to; to = t;
+        }
+        if (from >= s_.size()) return String();
+        return String(s_.substr(from, to - from));
+    }
+
+    bool startsWith(const String & prefix) const { return s_.compare(0, prefix.s_.size(), prefix.s_) == 0; }
+    bool endsWith(const String & suffix) const {
+        return s_.size() >= suffix.s_.size()
+                && s_.compare(s_.size() - suffix.s_.size(), suffix.s_.size(), suffix.s_) == 0;
+    }
+
+    long toInt() const { return atol(s_.c_str()); }
+    void toLowerCase() { for (size_t i = 0; i < s_.size(); ++i) s_[i] = tolower(s_[i]); }
+    void toUpperCase() { for (size_t i = 0; i < s_.size(); ++i) s_[i] = toupper(s_[i]); }
+
+    String & operator+=(const String & rhs) { s_ += rhs.s_; return *this; }
+    String & operator+=(const char * rhs) { s_ += rhs; return *this; }
+    String & operator+=(char rhs) { s_ += rhs; return *this; }
+
+    bool operator==(const String & rhs) const { return s_ == rhs.s_; }
+    bool operator!=(const String & rhs) const { return s_ != rhs.s_; }
+    bool operator==(const char * rhs) const { return s_ == rhs; }
+    bool operator!=(const char * rhs) const { return s_ != rhs; }
+
+private:
+    static int position(size_t index) { return index == std::string::npos ? -1 : static_cast<int>(index); }
+
+    std::string s_;
+};
+
+inline String operator+(const String & lhs, const String & rhs) { String r(lhs); r += rhs; return r; }
+inline String operator+(const String & lhs, const char * rhs) { String r(lhs); r += rhs; return r; }
+inline String operator+(const char * lhs, const String & rhs) { String r(lhs); r += rhs; return r; }
+inline String operator+(const String & lhs, char rhs) { String r(lhs); r += rhs; return r; }
+inline String operator+(char lhs, const String & rhs) { String r(lhs); r += rhs; return r; }
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t * buffer, size_t size) {
+        size_t n = 0;
+        while (size--) n += write(*buffer++);
+        return n;
+    }
+
+    size_t print(const char * s) { return write(reinterpret_cast<const uint8_t *>(s), strlen(s)); }
+    size_t print(const String & s) { return print(s.c_str()); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(unsigned char n) { return print(static_cast<unsigned long>(n)); }
+    size_t print(int n) { return print(static_cast<long>(n)); }
+    size_t print(unsigned int n) { return print(static_cast<unsigned long>(n)); }
+    size_t print(long n) { return print(std::to_string(n).c_str()); }
+    size_t print(unsigned long n) { return print(std::to_string(n).c_str()); }
+    size_t print(double n) { return print(std::to_string(n).c_str()); }
+
+    template <typename T>
+    size_t println(const T & value) { size_t n = print(value); return n + println(); }
+    size_t println() { return print("\r\n"); }
+};
+
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long) {}
+    void flush() {}
+    size_t write(uint8_t) { return 1; }
+};
+
+extern HardwareSerial Serial;
+
+#endif /* ARDUINO_H_ */
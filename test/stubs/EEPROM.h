@@ -0,0 +1,24 @@
+/*
+ * EEPROM.h
+ *
+ * Host stand-in for the Arduino EEPROM library, backed by RAM.
+ */
+
+#ifndef EEPROM_H_
+#define EEPROM_H_
+
+#include <Arduino.h>
+
+class EEPROMClass {
+public:
+    EEPROMClass() { memset(bytes_, 0xFF, sizeof(bytes_)); }
+    uint8_t read(int address) { return bytes_[address]; }
+    void write(int address, uint8_t value) { bytes_[address] = value; }
+
+private:
+    uint8_t bytes_[4096];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif /* EEPROM_H_ */
@@ -0,0 +1,53 @@
+/*
+ * Ethernet.h
+ *
+ * Host stand-in for the Arduino Ethernet library. Clients are backed by the
+ * fake sockets in fake_network.h.
+ */
+
+#ifndef ETHERNET_H_
+#define ETHERNET_H_
+
+#include <Arduino.h>
+#include <utility/w5100.h>
+
+class IPAddress {
+public:
+    IPAddress(uint8_t, uint8_t, uint8_t, uint8_t) {}
+};
+
+class EthernetClient : public Print {
+public:
+    EthernetClient() : sock_(MAX_SOCK_NUM) {}
+    explicit EthernetClient(uint8_t sock) : sock_(sock) {}
+
+    uint8_t status();
+    uint8_t connected();
+    int available();
+    int read();
+    int read(uint8_t * buffer, size_t size);
+    size_t write(uint8_t b);
+    size_t write(const uint8_t * buffer, size_t size);
+    void flush() {}
+    void stop();
+    operator bool() { return sock_ != MAX_SOCK_NUM; }
+
+private:
+    uint8_t sock_;
+};
+
+class EthernetServer {
+public:
+    explicit EthernetServer(uint16_t) {}
+    void begin() {}
+    EthernetClient available();
+};
+
+class EthernetClass {
+public:
+    void begin(uint8_t *, IPAddress) {}
+};
+
+extern EthernetClass Ethernet;
+
+#endif /* ETHERNET_H_ */
@@ -0,0 +1,10 @@
+/*
+ * SPI.h
+ *
+ * Host stand-in for the Arduino SPI library. The sketch only includes it.
+ */
+
+#ifndef SPI_H_
+#define SPI_H_
+
+#endif /* SPI_H_ */
@@ -0,0 +1,160 @@
+/*
+ * SdFat.h
+ *
+ * Host stand-in for SdFat. Files and directories live in the in-memory
+ * tree of fake_sd.h, and the blocks of contiguous files can be read and
+ * written directly through a RAM-backed card.
+ */
+
+#ifndef SDFAT_H_
+#define SDFAT_H_
+
+#include <map>
+#include <vector>
+
+#include <Arduino.h>
+
+#define O_READ   0x01
+#define O_WRITE  0x02
+#define O_RDWR   (O_READ | O_WRITE)
+#define O_AT_END 0x04
+#define O_TRUNC  0x10
+#define O_CREAT  0x20
+#define O_EXCL   0x40
+
+const uint8_t SPI_FULL_SPEED = 0;
+const uint8_t SPI_HALF_SPEED = 1;
+const uint8_t SPI_QUARTER_SPEED = 2;
+const uint8_t SPI_EIGHTH_SPEED = 3;
+const uint8_t SPI_SIXTEENTH_SPEED = 4;
+
+const uint8_t DIR_NAME_FREE = 0x00;
+const uint8_t DIR_NAME_DELETED = 0xE5;
+const uint8_t DIR_ATT_DIRECTORY = 0x10;
+const uint8_t DIR_ATT_VOLUME_ID = 0x08;
+
+struct dir_t {
+    uint8_t name[11];
+    uint8_t attributes;
+    uint8_t reservedNT;
+    uint8_t creationTimeTenths;
+    uint16_t creationTime;
+    uint16_t creationDate;
+    uint16_t lastAccessDate;
+    uint16_t firstClusterHigh;
+    uint16_t lastWriteTime;
+    uint16_t lastWriteDate;
+    uint16_t firstClusterLow;
+    uint32_t fileSize;
+};
+
+inline bool DIR_IS_SUBDIR(const dir_t * dir) { return (dir->attributes & DIR_ATT_DIRECTORY) != 0; }
+inline bool DIR_IS_FILE_OR_SUBDIR(const dir_t * dir) { return (dir->attributes & DIR_ATT_VOLUME_ID) == 0; }
+
+#define FAT_YEAR(date) (1980 + ((date) >> 9))
+#define FAT_MONTH(date) (((date) >> 5) & 0XF)
+#define FAT_DAY(date) ((date) & 0X1F)
+#define FAT_HOUR(time) ((time) >> 11)
+#define FAT_MINUTE(time) (((time) >> 5) & 0X3F)
+#define FAT_SECOND(time) (2 * ((time) & 0X1F))
+
+class SdVolume {};
+
+class Sd2Card {
+public:
+    Sd2Card() : corrupt_speed(0xFF), speed_(SPI_HALF_SPEED) {
+        memset(writes_at_speed, 0, sizeof(writes_at_speed));
+    }
+
+    bool setSckRate(uint8_t speed) { speed_ = speed; return true; }
+    bool readBlock(uint32_t block, uint8_t * dst) {
+        std::vector<uint8_t> & data = blocks[block];
+        data.resize(512);
+        memcpy(dst, &data[0], 512);
+        if (speed_ == corrupt_speed) {
+            dst[block % 512] ^= 1;
+        }
+        return true;
+    }
+    bool writeBlock(uint32_t block, const uint8_t * src) {
+        blocks[block].assign(src, src + 512);
+        ++writes_at_speed[speed_];
+        return true;
+    }
+
+    std::map<uint32_t, std::vector<uint8_t> > blocks;
+    uint8_t corrupt_speed;  // reads at this speed come back with a bit flipped
+    unsigned long writes_at_speed[SPI_SIXTEENTH_SPEED + 1];
+
+private:
+    uint8_t speed_;
+};
+
+// Contiguous files are given blocks from here on
+const uint32_t FAKE_CONTIGUOUS_FIRST_BLOCK = 1000;
+
+struct FakeEntry;
+
+class SdBaseFile {
+public:
+    SdBaseFile() : entry_(0), position_(0), flags_(0) {}
+
+    bool openRoot(SdVolume *);
+    bool open(SdBaseFile * dir, const char * path, uint8_t oflag);
+    bool open(SdBaseFile * dir, uint16_t index, uint8_t oflag);
+    bool createContiguous(SdBaseFile * dir, const char * path, uint32_t size);
+    bool contiguousRange(uint32_t * first, uint32_t * last);
+    bool close() { entry_ = 0; position_ = 0; flags_ = 0; return true; }
+
+    bool isOpen() const { return entry_ != 0; }
+    bool isRoot() const;
+    bool isDir() const;
+    bool isFile() const;
+
+    int8_t readDir(dir_t * dir);
+    void rewind() { position_ = 0; }
+    uint32_t curPosition() const { return position_; }
+    uint32_t fileSize() const;
+    bool seekSet(uint32_t position);
+
+    int16_t read();
+    int read(void * buffer, uint16_t size);
+    int write(const void * buffer, uint16_t size);
+    bool sync() { return isOpen(); }
+    bool truncate(uint32_t length);
+    bool remove();
+    bool rmdir();
+
+private:
+    FakeEntry * entry_;
+    uint32_t position_;
+    uint8_t flags_;
+};
+
+class SdFile : public SdBaseFile, public Print {
+public:
+    using SdBaseFile::write;
+    size_t write(uint8_t b) { return SdBaseFile::write(&b, 1) == 1 ? 1 : 0; }
+};
+
+class SdFat {
+public:
+    SdFat() { root_.openRoot(&volume_); }
+
+    bool begin(uint8_t, uint8_t) { return true; }
+    void initErrorHalt() {}
+    SdBaseFile * vwd() { return &root_; }
+    SdVolume * vol() { return &volume_; }
+    Sd2Card * card() { return &card_; }
+
+    bool mkdir(const char * path);
+    bool remove(const char * path);
+    bool rmdir(const char * path);
+
+private:
+    SdVolume volume_;
+    Sd2Card card_;
+    SdBaseFile root_;
+};
+
+#endif /* SDFAT_H_ */
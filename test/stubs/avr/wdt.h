@@ -0,0 +1,16 @@
+/*
+ * avr/wdt.h
+ *
+ * Host stand-in for the AVR watchdog, which does nothing.
+ */
+
+#ifndef AVR_WDT_H_
+#define AVR_WDT_H_
+
+#define WDTO_8S 9
+
+inline void wdt_enable(int) {}
+inline void wdt_disable() {}
+inline void wdt_reset() {}
+
+#endif /* AVR_WDT_H_ */
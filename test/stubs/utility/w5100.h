@@ -0,0 +1,21 @@
+/*
+ * utility/w5100.h
+ *
+ * Host stand-in for the W5100 definitions used by the sketch.
+ */
+
+#ifndef UTILITY_W5100_H_
+#define UTILITY_W5100_H_
+
+#include <Arduino.h>
+
+#define MAX_SOCK_NUM 4
+
+class SnSR {
+public:
+    static const uint8_t CLOSED      = 0x00;
+    static const uint8_t ESTABLISHED = 0x17;
+    static const uint8_t CLOSE_WAIT  = 0x1C;
+};
+
+#endif /* UTILITY_W5100_H_ */
@@ -0,0 +1,92 @@
+/*
+ * Tests for the SD and network benchmarks and the SPI speed setting. The
+ * stand-in card keeps blocks in RAM and can be told to corrupt reads at
+ * one speed.
+ */
+
+#include "check.h"
+#include "fake_network.h"
+
+#include "../main.cpp"
+
+static void testCorruptingSpeedIsRejected() {
+    Sd2Card * card = sd.card();
+    card->blocks.clear();
+    card->corrupt_speed = SPI_FULL_SPEED;
+    EEPROM.write(SD_SPEED_EEPROM_ADDRESS, 0xFF);
+
+    std::string response = fakeRequest("POST /api/bench?blocks=8&apply=1 HTTP/1.1");
+    CHECK(startsWith(response, "HTTP/1.1 200 OK"));
+    CHECK(contains(response, "{\"speed\":0,\"ok\":false}"));
+    CHECK(contains(response, "{\"speed\":1,\"ok\":true"));
+    CHECK(EEPROM.read(SD_SPEED_EEPROM_ADDRESS) == SPI_HALF_SPEED);
+    CHECK(sd_spi_speed == SPI_HALF_SPEED);
+
+    // Only the scratch file's data blocks were written
+    CHECK(card->blocks.size() == 8);
+    CHECK(card->blocks.begin()->first == FAKE_CONTIGUOUS_FIRST_BLOCK);
+    card->corrupt_speed = 0xFF;
+}
+
+static void testNoWriteAtSpeedWhichFailsToRead() {
+    Sd2Card * card = sd.card();
+    memset(card->writes_at_speed, 0, sizeof(card->writes_at_speed));
+    card->corrupt_speed = SPI_QUARTER_SPEED;
+
+    std::string response = fakeRequest("GET /api/bench?blocks=8 HTTP/1.1");
+    CHECK(contains(response, "{\"speed\":2,\"ok\":false}"));
+    CHECK(card->writes_at_speed[SPI_QUARTER_SPEED] == 0);
+    CHECK(card->writes_at_speed[SPI_FULL_SPEED] > 0);
+    // The slower speeds still read the pattern back intact
+    CHECK(contains(response, "{\"speed\":3,\"ok\":true"));
+    CHECK(contains(response, "{\"speed\":4,\"ok\":true"));
+    card->corrupt_speed = 0xFF;
+}
+
+static void testApplyNeedsPost() {
+    EEPROM.write(SD_SPEED_EEPROM_ADDRESS, 0xFF);
+    std::string response = fakeRequest("GET /api/bench?blocks=8&apply=1 HTTP/1.1");
+    CHECK(startsWith(response, "HTTP/1.1 405"));
+    CHECK(EEPROM.read(SD_SPEED_EEPROM_ADDRESS) == 0xFF);
+}
+
+static void testSpiSpeedNeedsPost() {
+    EEPROM.write(SD_SPEED_EEPROM_ADDRESS, 0xFF);
+    std::string response = fakeRequest("GET /api/spi?speed=3 HTTP/1.1");
+    CHECK(startsWith(response, "HTTP/1.1 405"));
+    CHECK(EEPROM.read(SD_SPEED_EEPROM_ADDRESS) == 0xFF);
+
+    response = fakeRequest("GET /api/spi HTTP/1.1");
+    CHECK(startsWith(response, "HTTP/1.1 200 OK"));
+
+    response = fakeRequest("POST /api/spi?speed=3 HTTP/1.1");
+    CHECK(contains(response, "{\"speed\":3}"));
+    CHECK(EEPROM.read(SD_SPEED_EEPROM_ADDRESS) == 3);
+    setSdSpiSpeed(SPI_HALF_SPEED, true);
+}
+
+static void testNetworkBenchmarksAreCapped() {
+    std::string response = fakeRequest("GET /api/bench/tx?size=1048577 HTTP/1.1");
+    CHECK(startsWith(response, "HTTP/1.1 400"));
+
+    response = fakeRequest("POST /api/bench/rx HTTP/1.1\r\nContent-Length: 1048577");
+    CHECK(startsWith(response, "HTTP/1.1 413"));
+
+    response = fakeRequest("POST /api/bench/rx HTTP/1.1", std::string(2000, 'x'));
+    CHECK(contains(response, "{\"bytes\":2000,"));
+}
+
+static void testRateDoesNotOverflow() {
+    CHECK(benchRate(10000000UL, 2000000UL) == 5000000UL);
+    CHECK(benchRate(512, 0) == 512000000UL);
+}
+
+int main() {
+    testCorruptingSpeedIsRejected();
+    testNoWriteAtSpeedWhichFailsToRead();
+    testApplyNeedsPost();
+    testSpiSpeedNeedsPost();
+    testNetworkBenchmarksAreCapped();
+    testRateDoesNotOverflow();
+    return checkReport("test_bench");
+}
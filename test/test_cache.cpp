@@ -0,0 +1,137 @@
+/*
+ * Tests for the path cache, counting the directory opens the stand-in SdFat
+ * is asked for.
+ */
+
+#include "check.h"
+#include "fake_network.h"
+#include "fake_sd.h"
+
+#include "../main.cpp"
+
+static void resetCache() {
+    pathCacheInvalidate();
+    path_cache_hits = 0;
+    path_cache_misses = 0;
+    path_cache_evictions = 0;
+    fake_sd_opens.clear();
+}
+
+static bool get(const std::string & path) {
+    return startsWith(fakeRequest("GET /sd/" + path + " HTTP/1.1"), "HTTP/1.1 200 OK");
+}
+
+static bool openedFrom(const char * dir, const char * name) {
+    for (size_t i = 0; i < fake_sd_opens.size(); ++i) {
+        if (fake_sd_opens[i].dir == dir && fake_sd_opens[i].name == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void testLongestCachedPrefix() {
+    resetFakeSd();
+    fakeSdMakeFile("A/B/C/X.TXT", "x");
+    fakeSdMakeFile("A/B/D/Y.TXT", "y");
+    resetCache();
+
+    CHECK(get("A/B/C/X.TXT"));
+    CHECK(fake_sd_opens.size() == 4);
+    CHECK(openedFrom("", "A"));
+    CHECK(openedFrom("A/B/C/", "X.TXT"));
+
+    fake_sd_opens.clear();
+    CHECK(get("A/B/C/X.TXT"));
+    CHECK(fake_sd_opens.size() == 1);
+    CHECK(openedFrom("A/B/C/", "X.TXT"));
+
+    fake_sd_opens.clear();
+    CHECK(get("A/B/D/Y.TXT"));
+    CHECK(fake_sd_opens.size() == 2);
+    CHECK(openedFrom("A/B/", "D"));
+}
+
+static void testKeysIgnoreCase() {
+    resetFakeSd();
+    fakeSdMakeFile("DATA/X.TXT", "x");
+    resetCache();
+
+    CHECK(get("data/X.TXT"));
+    fake_sd_opens.clear();
+    CHECK(get("DATA/X.TXT"));
+    CHECK(fake_sd_opens.size() == 1);
+    CHECK(openedFrom("DATA/", "X.TXT"));
+    CHECK(path_cache_hits == 1);
+}
+
+static void testParentIsNeverEvicted() {
+    resetFakeSd();
+    fakeSdMakeFile("P/Q/X.TXT", "x");
+    fakeSdMakeDir("W/");
+    fakeSdMakeDir("Y/");
+    fakeSdMakeDir("Z/");
+    resetCache();
+
+    // Fill the cache so that P/ is the least recently used entry
+    CHECK(resolveDir("P/") != 0);
+    CHECK(resolveDir("W/") != 0);
+    CHECK(resolveDir("Y/") != 0);
+    CHECK(resolveDir("Z/") != 0);
+    CHECK(path_cache_evictions == 0);
+
+    fake_sd_opens.clear();
+    CHECK(get("P/Q/X.TXT"));
+    CHECK(openedFrom("P/", "Q"));
+    CHECK(path_cache_evictions == 1);
+    fake_sd_opens.clear();
+    CHECK(get("P/Q/X.TXT"));
+    CHECK(openedFrom("P/Q/", "X.TXT"));
+}
+
+static void testCounters() {
+    resetFakeSd();
+    fakeSdMakeFile("A/B/X.TXT", "x");
+    resetCache();
+
+    CHECK(get("A/B/X.TXT"));
+    CHECK(get("A/B/X.TXT"));
+    CHECK(get("A/X.TXT") == false);
+    std::string response = fakeRequest("GET /api/cache HTTP/1.1");
+    CHECK(contains(response, "{\"hits\":2,\"misses\":1,\"evictions\":0,\"entries\":2,\"size\":4}"));
+}
+
+// A request which changes the tree below A/B/C/, after which the next open
+// there, whether by the request itself or by a later one, must start from
+// the root again
+static void checkInvalidatedBy(const std::string & head, const std::string & body) {
+    resetFakeSd();
+    fakeSdMakeFile("A/B/C/X.TXT", "x");
+    fakeSdMakeFile("A/B/C/Y.TXT", "y");
+    resetCache();
+    CHECK(get("A/B/C/X.TXT"));
+
+    fake_sd_opens.clear();
+    fakeRequest(head, body);
+    get("A/B/C/X.TXT");
+    CHECK(openedFrom("", "A"));
+}
+
+static void testMutatingRequestsInvalidate() {
+    checkInvalidatedBy("POST /upload HTTP/1.1\r\nContent-Type: multipart/form-data; boundary=XYZ",
+            "--XYZ\r\nContent-Disposition: form-data; name=\"path\"\r\n\r\nA/B/C/\r\n"
+            "--XYZ\r\nContent-Disposition: form-data; name=\"fileToUpload\"; filename=\"NEW.TXT\"\r\n\r\n"
+            "new\r\n--XYZ--\r\n");
+    checkInvalidatedBy("POST /delete HTTP/1.1", "path=A/B/C/&filename=Y.TXT");
+    checkInvalidatedBy("POST /mkdir HTTP/1.1", "path=A/B/C/&dirname=SUB");
+    checkInvalidatedBy("POST /api/delete HTTP/1.1", "path=A/B/C/&name=Y.TXT");
+}
+
+int main() {
+    testLongestCachedPrefix();
+    testKeysIgnoreCase();
+    testParentIsNeverEvicted();
+    testCounters();
+    testMutatingRequestsInvalidate();
+    return checkReport("test_cache");
+}
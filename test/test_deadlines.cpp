@@ -0,0 +1,78 @@
+/*
+ * Tests for the per-connection read deadlines, driving loop() against fake
+ * sockets and a fake clock. The sketch is included so that its limits are
+ * visible here.
+ */
+
+#include "check.h"
+#include "fake_network.h"
+
+#include "../main.cpp"
+
+static void testStalledClientDoesNotDelayGet() {
+    const char get[] = "GET /favicon.ico HTTP/1.1\r\n\r\n";
+
+    // How long the GET takes on its own
+    resetFakeNetwork();
+    fakeConnect(1, get);
+    runLoopUntil(60000, 1);
+    long unobstructed = fake_sockets[1].first_tx_at;
+
+    resetFakeNetwork();
+    // Sends part of a request line and then nothing more
+    fakeConnect(0, "GET /sd/ HT");
+    fakeConnect(1, get);
+    runLoopUntil(60000, 1);
+
+    CHECK(startsWith(fake_sockets[0].tx, "HTTP/1.1 408"));
+    CHECK(startsWith(fake_sockets[1].tx, "HTTP/1.1 410"));
+    CHECK(fake_sockets[1].first_tx_at >= 0);
+    // Allowing a few milliseconds for polling the sockets and sending the 408
+    CHECK(fake_sockets[1].first_tx_at - unobstructed <= static_cast<long>(HEADER_TIMEOUT_MS + 10));
+}
+
+static void testSilentSocketIsClosed() {
+    resetFakeNetwork();
+    // Connects and never sends anything, so is never handed to loop()
+    fakeConnect(0, "");
+
+    while (fake_clock < HEADER_TIMEOUT_MS + 500) {
+        loop();
+    }
+
+    CHECK(fake_sockets[0].status == SnSR::CLOSED);
+    CHECK(fake_sockets[0].closed_at >= static_cast<long>(HEADER_TIMEOUT_MS));
+    CHECK(fake_sockets[0].closed_at <= static_cast<long>(HEADER_TIMEOUT_MS + 50));
+}
+
+static void testSlowBodyIsEvicted() {
+    resetFakeNetwork();
+    // Headers at once, then the body one byte at a time, each just inside
+    // the idle timeout
+    std::string headers = "POST /mkdir HTTP/1.1\r\nContent-Length: 400\r\n\r\n";
+    fakeConnect(0, headers + std::string(400, 'x'), headers.size(), BODY_IDLE_TIMEOUT_MS - 100);
+
+    runLoopUntil(600000, 0);
+
+    CHECK(startsWith(fake_sockets[0].tx, "HTTP/1.1 408"));
+    CHECK(fake_sockets[0].first_tx_at <= static_cast<long>(MIN_RATE_GRACE_MS + BODY_IDLE_TIMEOUT_MS));
+}
+
+static void testOversizedFormBodyIsRefused() {
+    resetFakeNetwork();
+    fakeConnect(0, "POST /mkdir HTTP/1.1\r\nContent-Length: 1000000\r\n\r\npath=");
+
+    runLoopUntil(60000, 0);
+
+    CHECK(startsWith(fake_sockets[0].tx, "HTTP/1.1 413"));
+    CHECK(fake_sockets[0].first_tx_at <= 100);
+}
+
+int main() {
+    setup();
+    testStalledClientDoesNotDelayGet();
+    testSilentSocketIsClosed();
+    testSlowBodyIsEvicted();
+    testOversizedFormBodyIsRefused();
+    return checkReport("test_deadlines");
+}
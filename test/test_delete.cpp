@@ -0,0 +1,126 @@
+/*
+ * Tests for /api/delete, against the in-memory tree of the stand-in SdFat.
+ */
+
+#include "check.h"
+#include "fake_network.h"
+#include "fake_sd.h"
+
+#include "../main.cpp"
+
+static std::string bulkDelete(const std::string & body) {
+    return fakeRequest("POST /api/delete HTTP/1.1", body);
+}
+
+static void testManyNamesInOneBody() {
+    resetFakeSd();
+    // Far longer than MAX_FORM_CONTENT_LENGTH, so it must be streamed
+    std::string body = "path=/LOGS/&recursive=1";
+    for (int i = 0; i < 300; ++i) {
+        std::string name = "LOG" + std::to_string(i) + ".TXT";
+        fakeSdMakeFile("LOGS/" + name, "x");
+        body += "&name=" + name;
+    }
+    body += "&name=MISSING.TXT";
+    std::string response = bulkDelete(body);
+    CHECK(startsWith(response, "HTTP/1.1 200 OK"));
+    CHECK(count(response, "\"ok\":true,\"removed\":1}") == 300);
+    CHECK(count(response, "{\"path\":\"LOGS/LOG299.TXT\"") == 1);
+    CHECK(count(response, "{\"path\":\"LOGS/MISSING.TXT\",\"ok\":false}") == 1);
+    CHECK(count(response, "\"complete\":true}") == 1);
+    CHECK(fakeSdFind("LOGS/LOG0.TXT") == 0);
+    CHECK(fakeSdFind("LOGS/LOG299.TXT") == 0);
+}
+
+static void testNamesAreEscaped() {
+    resetFakeSd();
+    std::string response = bulkDelete("path=&name=A%22B%5CC");
+    CHECK(count(response, "{\"path\":\"A\\\"B\\\\C\",\"ok\":false}") == 1);
+}
+
+static void testMissingName() {
+    std::string response = bulkDelete("path=/LOGS/");
+    CHECK(startsWith(response, "HTTP/1.1 400"));
+}
+
+static void testLongPairIsTooLarge() {
+    std::string response = bulkDelete("name=" + std::string(300, 'A'));
+    CHECK(startsWith(response, "HTTP/1.1 413"));
+}
+
+static void testDisconnectIsNotTooLarge() {
+    resetFakeNetwork();
+    // Sends part of the body and half-closes
+    fakeConnect(0, "POST /api/delete HTTP/1.1\r\nContent-Length: 100\r\n\r\npath=/LO");
+    fake_sockets[0].status = SnSR::CLOSE_WAIT;
+    runLoopUntil(60000, 0);
+    CHECK(startsWith(fake_sockets[0].tx, "HTTP/1.1 400"));
+}
+
+static void testRecursiveRemoval() {
+    resetFakeSd();
+    fakeSdMakeFile("DATA/A.TXT", "a");
+    fakeSdMakeFile("DATA/SUB/B.TXT", "b");
+    fakeSdMakeFile("DATA/SUB/DEEP/C.TXT", "c");
+    fakeSdMakeDir("DATA/SUB/EMPTY/");
+    fakeSdMakeFile("DATA/Z.TXT", "z");
+    fakeSdMakeFile("OTHER/KEEP.TXT", "k");
+
+    std::string response = bulkDelete("recursive=1&name=DATA/");
+    // Four files and four directories, DATA itself included
+    CHECK(contains(response, "{\"path\":\"DATA/\",\"ok\":true,\"removed\":8}"));
+    CHECK(fakeSdFind("DATA/") == 0);
+    CHECK(fakeSdFind("OTHER/KEEP.TXT") != 0);
+    CHECK(walk_depth == -1);
+}
+
+static void testNonRecursiveNeedsEmptyDirectory() {
+    resetFakeSd();
+    fakeSdMakeFile("DATA/A.TXT", "a");
+    fakeSdMakeDir("EMPTY/");
+
+    std::string response = bulkDelete("name=DATA/&name=EMPTY/");
+    CHECK(contains(response, "{\"path\":\"DATA/\",\"ok\":false}"));
+    CHECK(contains(response, "{\"path\":\"EMPTY/\",\"ok\":true,\"removed\":1}"));
+    CHECK(fakeSdFind("DATA/A.TXT") != 0);
+    CHECK(fakeSdFind("EMPTY/") == 0);
+}
+
+static void testTreeDeeperThanWalkIsPartlyRemoved() {
+    resetFakeSd();
+    // T is at depth 0 of the walk, so L8 is one level beyond WALK_MAX_DEPTH
+    std::string deep = "T/L1/L2/L3/L4/L5/L6/L7/L8/";
+    fakeSdMakeFile(deep + "F.TXT", "f");
+    fakeSdMakeFile("T/TOP.TXT", "t");
+    fakeSdMakeFile("T/L1/MID.TXT", "m");
+
+    std::string response = bulkDelete("recursive=1&name=T/");
+    CHECK(contains(response, "{\"path\":\"T/\",\"ok\":false}"));
+    CHECK(fakeSdFind("T/TOP.TXT") == 0);
+    CHECK(fakeSdFind("T/L1/MID.TXT") == 0);
+    CHECK(fakeSdFind(deep + "F.TXT") != 0);
+    CHECK(fakeSdFind("T/L1/L2/L3/L4/L5/L6/L7/") != 0);
+    CHECK(walk_depth == -1);
+}
+
+static void testRootIsRefused() {
+    resetFakeSd();
+    fakeSdMakeFile("KEEP.TXT", "k");
+
+    std::string response = bulkDelete("recursive=1&name=/");
+    CHECK(contains(response, "{\"path\":\"/\",\"ok\":false}"));
+    CHECK(fakeSdFind("KEEP.TXT") != 0);
+}
+
+int main() {
+    testManyNamesInOneBody();
+    testNamesAreEscaped();
+    testMissingName();
+    testLongPairIsTooLarge();
+    testDisconnectIsNotTooLarge();
+    testRecursiveRemoval();
+    testNonRecursiveNeedsEmptyDirectory();
+    testTreeDeeperThanWalkIsPartlyRemoved();
+    testRootIsRefused();
+    return checkReport("test_delete");
+}
@@ -0,0 +1,134 @@
+/*
+ * Tests for /api/find: name matching, timestamp parsing and the walk over
+ * the in-memory tree of the stand-in SdFat.
+ */
+
+#include "check.h"
+#include "fake_network.h"
+#include "fake_sd.h"
+
+#include "../main.cpp"
+
+static bool matches(const char * raw_name, const char * glob) {
+    dir_t p;
+    memcpy(p.name, raw_name, sizeof(p.name));
+    return matchDirName(p, glob);
+}
+
+static void testMatchDirName() {
+    CHECK(matches("DATA    CSV", "*.CSV"));
+    CHECK(matches("DATA    CSV", "*.csv"));
+    CHECK(matches("DATA    CSV", "D?TA.CSV"));
+    CHECK(matches("DATA    CSV", "*"));
+    CHECK(!matches("DATA    CSV", "*.TXT"));
+    CHECK(matches("README     ", "README"));
+    CHECK(matches("README     ", "R*E"));
+    CHECK(!matches("README     ", "README.*"));
+}
+
+static void testParseFatTimestamp() {
+    uint32_t timestamp;
+    CHECK(parseFatTimestamp("2014-01-31T12:30:10", timestamp));
+    CHECK(timestamp == 0x443F63C5UL);
+    CHECK(parseFatTimestamp("2014-01-31", timestamp));
+    CHECK(timestamp == 0x443F0000UL);
+    CHECK(parseFatTimestamp("2107-12-31T23:59:59", timestamp));
+
+    CHECK(!parseFatTimestamp("2014-01", timestamp));
+    CHECK(!parseFatTimestamp("1979-12-31", timestamp));
+    CHECK(!parseFatTimestamp("2108-01-01", timestamp));
+    CHECK(!parseFatTimestamp("2014-13-01", timestamp));
+    CHECK(!parseFatTimestamp("2014-00-01", timestamp));
+    CHECK(!parseFatTimestamp("2014-01-32", timestamp));
+    CHECK(!parseFatTimestamp("2014-01-00", timestamp));
+    CHECK(!parseFatTimestamp("2014-01-31T24:00:00", timestamp));
+    CHECK(!parseFatTimestamp("2014-01-31T12:60:00", timestamp));
+    CHECK(!parseFatTimestamp("2014-01-31T12:30:60", timestamp));
+}
+
+static std::string find(const std::string & query) {
+    return fakeRequest("GET /api/find?" + query + " HTTP/1.1");
+}
+
+// 2014-01-31T12:30:10, as FAT stores it
+const uint16_t DATE_2014 = 0x443F;
+const uint16_t TIME_2014 = 0x63C5;
+
+static void makeTree() {
+    resetFakeSd();
+    fakeSdMakeFile("DATA/A.CSV", "a");   // from a logger without a clock
+    fakeSdMakeFile("DATA/SUB/B.CSV", "bb", DATE_2014, TIME_2014);
+    fakeSdMakeFile("DATA/SUB/C.TXT", "c");
+    fakeSdMakeFile("DATA/Z.CSV", "z");
+    fakeSdMakeFile("OTHER/O.CSV", "o");
+}
+
+static void testWalkFindsMatchesAtEveryDepth() {
+    makeTree();
+    std::string response = find("root=/DATA/&glob=*.CSV");
+    CHECK(startsWith(response, "HTTP/1.1 200 OK"));
+    CHECK(contains(response, "{\"path\":\"/DATA/A.CSV\",\"dir\":false,\"size\":1,"
+            "\"modified\":\"1980-00-00T00:00:00\"}\r\n"));
+    CHECK(contains(response, "{\"path\":\"/DATA/SUB/B.CSV\",\"dir\":false,\"size\":2,"
+            "\"modified\":\"2014-01-31T12:30:10\"}\r\n"));
+    // The path is back to the parent once SUB/ has been walked
+    CHECK(contains(response, "{\"path\":\"/DATA/Z.CSV\""));
+    CHECK(count(response, "{\"path\":") == 3);
+    CHECK(walk_depth == -1);
+}
+
+static void testDirectoriesMatchToo() {
+    makeTree();
+    std::string response = find("root=DATA&glob=S*");
+    CHECK(contains(response, "{\"path\":\"/DATA/SUB\",\"dir\":true,"));
+    CHECK(count(response, "{\"path\":") == 1);
+}
+
+static void testNewerFiltersOnlyWhenGiven() {
+    makeTree();
+    std::string response = find("root=/&glob=*.CSV&newer=2014-01-01");
+    CHECK(count(response, "{\"path\":") == 1);
+    CHECK(contains(response, "{\"path\":\"/DATA/SUB/B.CSV\""));
+
+    response = find("root=/&glob=*.CSV");
+    CHECK(count(response, "{\"path\":") == 4);
+    CHECK(contains(response, "{\"path\":\"/OTHER/O.CSV\""));
+}
+
+static void testTooDeepIsReported() {
+    resetFakeSd();
+    // T is at depth 0 of the walk, so L8 is one level beyond WALK_MAX_DEPTH
+    fakeSdMakeFile("T/L1/L2/L3/L4/L5/L6/L7/L8/DEEP.TXT", "d");
+    fakeSdMakeFile("T/L1/L2/L3/L4/L5/L6/L7/SHALLOW.TXT", "s");
+    std::string response = find("root=/T/&glob=*.TXT");
+    CHECK(contains(response, "{\"path\":\"/T/L1/L2/L3/L4/L5/L6/L7/SHALLOW.TXT\""));
+    CHECK(contains(response, "{\"error\":\"Too deep\",\"path\":\"/T/L1/L2/L3/L4/L5/L6/L7/L8\"}\r\n"));
+    CHECK(!contains(response, "DEEP.TXT"));
+    CHECK(walk_depth == -1);
+}
+
+static void testOneWritePerLine() {
+    makeTree();
+    find("root=/DATA/&glob=Z.CSV");
+    unsigned long one_match = fake_sockets[0].writes;
+    find("root=/DATA/&glob=*.CSV");
+    CHECK(fake_sockets[0].writes == one_match + 2);
+}
+
+static void testMissingRoot() {
+    resetFakeSd();
+    CHECK(startsWith(find("root=/NONE/"), "HTTP/1.1 404"));
+    CHECK(startsWith(find("root=/&newer=2014-13-01"), "HTTP/1.1 400"));
+}
+
+int main() {
+    testMatchDirName();
+    testParseFatTimestamp();
+    testWalkFindsMatchesAtEveryDepth();
+    testDirectoriesMatchToo();
+    testNewerFiltersOnlyWhenGiven();
+    testTooDeepIsReported();
+    testOneWritePerLine();
+    testMissingRoot();
+    return checkReport("test_find");
+}
@@ -0,0 +1,115 @@
+/*
+ * Tests for the multipart upload summary.
+ */
+
+#include "check.h"
+#include "fake_network.h"
+#include "fake_sd.h"
+
+#include "../main.cpp"
+
+static std::string upload(const std::string & body, unsigned long interval = 0) {
+    return fakeRequest("POST /upload HTTP/1.1\r\nContent-Type: multipart/form-data; boundary=XYZ",
+            body, interval);
+}
+
+static std::string filePart(const char * filename, const std::string & content) {
+    return std::string("--XYZ\r\nContent-Disposition: form-data; name=\"fileToUpload\"; filename=\"")
+            + filename + "\"\r\nContent-Type: application/octet-stream\r\n\r\n" + content + "\r\n";
+}
+
+static void checkFilesStored(unsigned long interval) {
+    resetFakeSd();
+    fakeSdMakeDir("DATA/");
+    // Content which looks like the start of the delimiter, which is CRLF,
+    // "--" and the boundary, in every way short of being it
+    std::string first = "a\r\n--XYb\r\r\n--X\r\n-\r\n\r\n--XY\r";
+    for (int i = 0; i < 1000; ++i) {
+        first += static_cast<char>(i % 7 == 0 ? '\r' : i % 251);
+    }
+    first += "\r\n--XY";
+    std::string second = "second file\r\n";
+
+    std::string response = upload(
+            "--XYZ\r\nContent-Disposition: form-data; name=\"path\"\r\n\r\nDATA/\r\n"
+            + filePart("ONE.BIN", first) + filePart("TWO.TXT", second) + "--XYZ--\r\n",
+            interval);
+    CHECK(contains(response, "],\"complete\":true}"));
+    FakeEntry * one = fakeSdFind("DATA/ONE.BIN");
+    FakeEntry * two = fakeSdFind("DATA/TWO.TXT");
+    CHECK(one != 0 && one->data == first);
+    CHECK(two != 0 && two->data == second);
+}
+
+static void testFilesAreStored() {
+    checkFilesStored(0);
+}
+
+static void testFilesArrivingSlowlyAreStored() {
+    checkFilesStored(1);
+}
+
+static void testJsonEscape() {
+    CHECK(jsonEscape("PLAIN.TXT") == "PLAIN.TXT");
+    CHECK(jsonEscape("A\"B\\C") == "A\\\"B\\\\C");
+    CHECK(jsonEscape("\n") == "\\u000a");
+}
+
+static void testSummaryEscapesNames() {
+    std::string response = upload(
+            "--XYZ\r\nContent-Disposition: form-data; name=\"path\"\r\n\r\nDIR\\\r\n"
+            "--XYZ\r\nContent-Disposition: form-data; name=\"fileToUpload\"; filename=\"A\\B.TXT\"\r\n\r\n"
+            "data\r\n--XYZ--\r\n");
+    CHECK(startsWith(response, "HTTP/1.1 200 OK"));
+    CHECK(contains(response, "{\"files\":[\r\n{\"path\":\"DIR\\\\A\\\\B.TXT\",\"ok\":false"));
+    CHECK(contains(response, "],\"complete\":true}"));
+}
+
+static void testBrokenPartStillGetsSummary() {
+    resetFakeSd();
+    // The second file part never ends, so the upload times out
+    std::string response = upload(
+            "--XYZ\r\nContent-Disposition: form-data; name=\"path\"\r\n\r\n\r\n"
+            "--XYZ\r\nContent-Disposition: form-data; name=\"fileToUpload\"; filename=\"ONE.TXT\"\r\n\r\n"
+            "one\r\n--XYZ\r\n"
+            "Content-Disposition: form-data; name=\"fileToUpload\"; filename=\"TWO.TXT\"\r\n\r\n"
+            "tw");
+    CHECK(contains(response, "{\"path\":\"ONE.TXT\",\"size\":3,\"ok\":true}"));
+    CHECK(contains(response, "],\"complete\":false,\"error\":\"Timed out\",\"part\":\"TWO.TXT\"}"));
+    CHECK(fakeSdFind("TWO.TXT") == 0);
+}
+
+static void testManyFilesAreStreamed() {
+    resetFakeSd();
+    fakeSdMakeDir("LOGS/");
+    std::string body = "--XYZ\r\nContent-Disposition: form-data; name=\"path\"\r\n\r\nLOGS/\r\n";
+    for (int i = 0; i < 60; ++i) {
+        body += "--XYZ\r\nContent-Disposition: form-data; name=\"fileToUpload\"; filename=\"LOG"
+                + std::to_string(i) + ".TXT\"\r\n\r\nx\r\n";
+    }
+    body += "--XYZ--\r\n";
+    std::string response = upload(body);
+    CHECK(count(response, "\"size\":1,\"ok\":true}") == 60);
+    CHECK(count(response, "{\"path\":\"LOGS/LOG59.TXT\"") == 1);
+    CHECK(contains(response, "],\"complete\":true}"));
+    CHECK(fakeSdFind("LOGS/LOG59.TXT") != 0);
+}
+
+static void testSocketIsReadInWholeBuffers() {
+    resetFakeSd();
+    std::string body = filePart("BIG.BIN", std::string(20000, 'x')) + "--XYZ--\r\n";
+    std::string response = upload(body);
+    CHECK(contains(response, "{\"path\":\"BIG.BIN\",\"size\":20000,\"ok\":true}"));
+    CHECK(fake_sockets[0].reads <= body.size() / HTTP_BUFFER_SIZE + 3);
+}
+
+int main() {
+    testJsonEscape();
+    testSummaryEscapesNames();
+    testBrokenPartStillGetsSummary();
+    testManyFilesAreStreamed();
+    testFilesAreStored();
+    testFilesArrivingSlowlyAreStored();
+    testSocketIsReadInWholeBuffers();
+    return checkReport("test_upload");
+}
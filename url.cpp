@@ -37,4 +37,29 @@ void url_decode(char *dst, const char *src)
         *dst++ = '\0';
 }
 
-
+/**
+ * The decoded value of the query string parameter key in url, or an
+ * empty String if it is absent.
+ */
+String url_query_param(const String & url, const String & key)
+{
+        int query = url.indexOf('?');
+        if (query < 0) {
+                return String();
+        }
+        String params = url.substring(query + 1);
+        int from = 0;
+        while (from < static_cast<int>(params.length())) {
+                int end = params.indexOf('&', from);
+                if (end < 0) {
+                        end = params.length();
+                }
+                int equals = params.indexOf('=', from);
+                if (equals >= 0 && equals < end &&
+                    params.substring(from, equals) == key) {
+                        return url_decode(params.substring(equals + 1, end));
+                }
+                from = end + 1;
+        }
+        return String();
+}
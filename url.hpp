@@ -12,4 +12,6 @@ String url_decode(const String & src);
 
 void url_decode(char *dst, const char *src);
 
+String url_query_param(const String & url, const String & key);
+
 #endif /* URL_HPP_ */